@@ -22,7 +22,11 @@
 
 #include "src/adsr.h"
 #include "src/debug.h"
+#include "src/lfo.h"
 #include "src/math.h"
+#include "src/propsratecontrolsource.h"
+#include "src/rtcheck.h"
+#include "src/sratebuf.h"
 #include "src/voice.h"
 
 #include "libbuzztrax-gst/audiosynth.h"
@@ -52,37 +56,159 @@ GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("audio/x-raw, "
-        "format = (string) " GST_AUDIO_NE (F32) ", "
-        "layout = (string) interleaved, "
-        "rate = (int) [ 1, MAX ], " "channels = (int) 2")
+        "format = (string) { " GST_AUDIO_NE (F32) ", " GST_AUDIO_NE (S16) ", " GST_AUDIO_NE (S32) " }, "
+        "layout = (string) { interleaved, non-interleaved }, "
+        "rate = (int) [ 1, MAX ], " "channels = (int) [ 1, 2 ]")
     );
 
 
 enum { MAX_OVERTONES = 600 };
 enum { MAX_VIRTUAL_VOICES = 10 };
 
+// Frames rendered by each step of the overtone loop. The s-rate buffers only need to hold this many frames.
+enum { TILE_FRAMES = 128 };
+
+// Output buffers from the element's own pool are aligned to a cache line.
+enum { OUTPUT_ALIGN = 64 };
+enum { OUTPUT_POOL_MIN_BUFFERS = 4 };
+
+// Alignment of the buffers in the arena. A cache line, so that no two buffers share one.
+enum { ARENA_ALIGN = 64 };
+
+// Limits for the internal-block-frames property. The largest frame is stereo F32.
+enum { MAX_BLOCK_FRAMES = 8192 };
+enum { MAX_FRAME_SIZE = 2 * sizeof(gfloat) };
+
+enum { MAX_CONTROL_RATE_DIVISOR = 64 };
+
+// Limit for the partial-ramp-frames property, which must be a multiple of 4 so that ramps start on a whole group.
+enum { MAX_PARTIAL_RAMP_FRAMES = 64 };
+enum { MAX_RAMP_SEGMENTS = TILE_FRAMES / 4 };
+
+// Flags the params_shared slot index when the slot holds a copy that rendering hasn't taken yet.
+enum { PARAMS_FRESH = 4 };
+
+// The most notes that can wait to be played. Any more are dropped.
+enum { MAX_EVENTS = 64 };
+
+// The shapes of output buffer that can be negotiated. Each has its own variant of mix_tile.
+typedef enum {
+  OUTPUT_INTERLEAVED,         // stereo, LRLR...
+  OUTPUT_PLANAR,              // stereo, a plane of left samples followed by a plane of right samples
+  OUTPUT_MONO,
+  N_OUTPUT_LAYOUTS
+} OutputLayout;
+
+// The negotiable sample formats, all native endian. Conversion from float happens in mix_tile as the output is
+// written.
+typedef enum {
+  OUTPUT_F32,
+  OUTPUT_S16,
+  OUTPUT_S32,
+  N_OUTPUT_FORMATS
+} OutputFormat;
+
 typedef struct {
   gfloat accum_rads;
   gfloat accum_rm_rads;
+
+  // The phase increment and amplitude reached at the end of the last tile, when rendering with partial-ramp-frames.
+  // Only valid if "ramp_primed" is set.
+  gfloat ramp_inc;
+  gfloat ramp_amp;
+  gboolean ramp_primed;
 } StateOvertone;
 
 typedef struct {
   GstBtAudioSynthClass parent_class;
 } GstBtAdditiveClass;
 
+// How an s-rate property's control binding is read.
+typedef enum {
+  // Through gst_control_binding_get_value_array, which can allocate. For bindings that aren't direct.
+  SRATE_READ_BINDING,
+  // From the source of a direct binding, which is mapped to the property as the binding would.
+  SRATE_READ_DIRECT,
+  // As SRATE_READ_DIRECT, from a GstBtPropSrateControlSource, which makes floats.
+  SRATE_READ_DIRECT_SRATE_CS
+} SrateRead;
+
+// The control binding of an s-rate property, if it has one, and the values last read from it. "n_values" is zero
+// if there are none.
+typedef struct {
+  GstControlBinding* binding;
+  SrateRead read;
+  // The source of a direct binding, and whether it gives the property's values rather than a range of 0 to 1.
+  GstControlSource* source;
+  gboolean absolute;
+  GstClockTime timestamp;
+  GstClockTime interval;
+  guint n_values;
+  v4sf values4[TILE_FRAMES/4];
+} SrateBinding;
+
+// A note to play at a running time, or GST_CLOCK_TIME_NONE to play it at the start of the next block rendered.
+typedef struct {
+  GstClockTime time;
+  GstBtNote note;
+} Event;
+
 typedef struct {
   GstBtNote note;
   StateOvertone states_overtone[MAX_OVERTONES];
   GstBtAdditiveV* voices[MAX_VOICES];
   gfloat* buf_srate_props;
-  gboolean props_srate_nonzero[N_PROPERTIES_SRATE];
-  gboolean props_srate_controlled[N_PROPERTIES_SRATE];
+  SrateBufDesc srate_descs[N_PROPERTIES_SRATE];
+
+  // Control points for control-rate-divisor above 1, laid out as buf_srate_props, and the ramp in progress between
+  // the last two points for each property. "ctrl_pos" is the number of frames since the last point.
+  gfloat* buf_ctrl;
+  SrateBufDesc ctrl_descs[N_PROPERTIES_SRATE];
+  gfloat ctrl_from[N_PROPERTIES_SRATE];
+  gfloat ctrl_to[N_PROPERTIES_SRATE];
+  guint ctrl_pos;
+  gboolean ctrl_primed;
+
+  // The number of overtones rendered in the last tile, which may have ramp state from it.
+  guint overtones_ramp_primed;
+  
+  // Planar left and right channels for the current tile, TILE_FRAMES each, before volume is applied. The right
+  // channel is only written if "tile_stereo" is set, otherwise it's identical to the left.
+  gfloat* buf_tile;
+  gboolean tile_silent;
+  gboolean tile_stereo;
 } StateVirtualVoice;
 
-// Class instance data.
+// What rendering needs that setters make: the voices, and backing memory for all of the rendering buffers, with room
+// for "n_vvoices" virtual voices' copies of "n_voices" voices and a staging block of "block_frames". Setters make new
+// resources and hand them to rendering in the parameters. See resources_update.
+typedef struct Resources {
+  guint8* mem;
+  // "mem" aligned to ARENA_ALIGN.
+  guint8* base;
+  guint n_voices;
+  guint n_vvoices;
+  guint block_frames;
+  GstBtAdditiveV* voices[MAX_VOICES];
+  GstBtAdditiveV* vvoice_voices[MAX_VIRTUAL_VOICES][MAX_VOICES];
+  // Resources are numbered in the order they're made.
+  guint serial;
+  // The resources that replaced these, if they've been replaced.
+  struct Resources* next;
+} Resources;
+
+// Resets of rendering state that property changes ask for. They're done on the streaming thread, at the start of the
+// next block.
+typedef enum {
+  RESET_RINGMOD_PHASE,  // restart every overtone's phase at ringmod-ot-offset
+  RESET_CTRL,           // restart the control-rate-divisor ramps
+  RESET_RAMPS,          // forget the partial-ramp-frames ramps
+  RESET_VVOICES,        // restart the virtual voices beyond virtual-voices, so they're fresh if they're used again
+  N_RESETS
+} Reset;
+
+// The values of the element's plain properties. See params_publish.
 typedef struct {
-  GstBtAudioSynth parent;
-
   guint overtones;
   gfloat freq_max;
   gint sum_start_idx;
@@ -100,38 +226,157 @@ typedef struct {
   gfloat ringmod_depth;
   gfloat ringmod_ot_offset;
   gfloat stereo;
+  // The virtual-voices property.
+  guint n_virtual_voices;
+  // The children property: the number of master voices, each copied into every virtual voice.
+  guint n_voices;
   gboolean release_on_note;
   gfloat vol;
-  GstBtNote note;
   gfloat anticlick;
-  
-  // These are standard Buzztrax voices, repurposed as ADSR+LFOs.
-  gulong n_voices;
+  gboolean dither;
+  // The s-rate properties, and so the voices' ADSRs and LFOs, are evaluated every this many frames.
+  guint control_rate_divisor;
+  // If non-zero, each overtone's frequency and amplitude are evaluated every this many frames and ramped between.
+  guint partial_ramp_frames;
+  // If non-zero, rendering happens in blocks of this many frames rather than a whole buffer at a time.
+  guint block_frames;
+  // The voices, and room for the buffers, needed by the values above.
+  Resources* resources;
+
+  // The number of times each Reset has been asked for.
+  guint resets[N_RESETS];
+} GstBtAdditiveParams;
+
+// Class instance data.
+typedef struct {
+  GstBtAudioSynth parent;
+
+  // Setters can run on any thread, and rendering mustn't see a half made change or wait for a setter to finish.
+  // Setters edit "params_edit" under "params_lock" and publish a copy of it to one of "params_slots", and rendering
+  // takes the latest copy at the start of each block. Each of the three slots is owned by either the setters
+  // ("params_back"), rendering ("params_front") or neither ("params_shared", which also holds PARAMS_FRESH until
+  // rendering takes it). See params_publish and params_acquire.
+  GMutex params_lock;
+  GstBtAdditiveParams params_edit;
+  GstBtAdditiveParams params_slots[3];
+  guint params_back;
+  gint params_shared;
+  guint params_front;
+  // The copy used for rendering.
+  const GstBtAdditiveParams* params;
+  // The number of times that rendering has done each Reset.
+  guint resets_done[N_RESETS];
 
+  GstBtNote note;
+
+  // Notes wait here until rendering reaches their time, so that they start on the right frame whatever the buffer
+  // size. Notes can come from any thread: they're added to the ring "events" under "events_lock", and rendering moves
+  // them to "events_pending", which it keeps in time order. "events_head" and "events_tail" count the notes added to
+  // and taken from the ring. See events_push and render_frames.
+  GMutex events_lock;
+  Event events[MAX_EVENTS];
+  guint events_head;
+  guint events_tail;
+  Event events_pending[MAX_EVENTS];
+  guint n_events_pending;
+  // The running time of the controller sync being done by process, or GST_CLOCK_TIME_NONE. Written with atomics.
+  GstClockTime sync_running_time;
+  // The thread that last ran process, which does the controller syncs. Written with atomics.
+  GThread* streaming_thread;
+  
   // These are the 'virtual voices' allowing multiple notes to play.
-  guint n_virtual_voices;
   guint idx_next_virtual_voice;
   StateVirtualVoice virtual_voices[MAX_VIRTUAL_VOICES];
-  GstBtAdditiveV* voices[MAX_VOICES];
 
-  gfloat ringmod_ot_offset_calc;
+  // These are standard Buzztrax voices, repurposed as ADSR+LFOs. Rendering's copy of the ones in "resources".
+  GstBtAdditiveV* voices[MAX_VOICES];
   
   GstBtToneConversion* tones;
 
-  guint buf_samples;
-  guint nsamples_available;
-  gfloat* buf;
+  // Size in bytes of the buffers in the output pool negotiated in decide_allocation.
+  guint pool_buffer_size;
+  OutputLayout output_layout;
+  OutputFormat output_format;
+  v4ui dither_state;
+
+  // The frames of the block straddling the end of the previous buffer. Sized for the largest frame size.
+  guint8* staging;
+  guint staging_frames;
+  guint staging_offset;
+  // The PTS of the first unconsumed staged frame.
+  GstClockTime staging_pts;
+
+  // The resources that rendering uses, and their serial, which setters read to know which older ones are free to go.
+  // The setters' resources run from "resources_oldest", the oldest that might still be in use, through each one's
+  // "next" to the newest. Setters that change them hold "resources_lock". See resources_update and resources_adopt.
+  GMutex resources_lock;
+  const Resources* resources;
+  guint resources_adopted;
+  Resources* resources_oldest;
+
+  // Each s-rate property's value, read from its field once per block and shared by all virtual voices.
+  gfloat props_srate_base[N_PROPERTIES_SRATE];
+  // Automated s-rate properties are read from their control bindings at every frame that's evaluated, rather than
+  // from their fields, so that they change smoothly within a block. The bindings are checked for changes once per
+  // block. They're in stream time, which is "srate_binding_offset" ahead of running time, and aren't read if
+  // "srate_bindings_timed" is unset because there's no PTS.
+  SrateBinding srate_bindings[N_PROPERTIES_SRATE];
+  GstClockTimeDiff srate_binding_offset;
+  gboolean srate_bindings_timed;
+  // Room for reading sources that make doubles.
+  gdouble srate_binding_scratch[TILE_FRAMES];
 
   gint samples_generated;
   long time_accum;
+
+  // Allocation checks on the streaming thread, for debug builds.
+  RtCheck rt_check;
 } GstBtAdditive;
 
+typedef enum {
+  FIELD_FLOAT,
+  FIELD_INT,
+  FIELD_UINT
+} FieldType;
+
+// The field of GstBtAdditiveParams holding the value of each s-rate property.
+static const struct {
+  glong offset;
+  FieldType type;
+} srate_prop_fields[N_PROPERTIES_SRATE] = {
+  [PROP_FREQ_MAX] = {G_STRUCT_OFFSET(GstBtAdditiveParams, freq_max), FIELD_FLOAT},
+  [PROP_SUM_START_IDX] = {G_STRUCT_OFFSET(GstBtAdditiveParams, sum_start_idx), FIELD_INT},
+  [PROP_AMP_POW_BASE] = {G_STRUCT_OFFSET(GstBtAdditiveParams, amp_pow_base), FIELD_FLOAT},
+  [PROP_AMP_EXP_IDX_MUL] = {G_STRUCT_OFFSET(GstBtAdditiveParams, amp_exp_idx_mul), FIELD_FLOAT},
+  [PROP_AMPFREQ_SCALE_IDX_MUL] = {G_STRUCT_OFFSET(GstBtAdditiveParams, ampfreq_scale_idx_mul), FIELD_FLOAT},
+  [PROP_AMPFREQ_SCALE_OFFSET] = {G_STRUCT_OFFSET(GstBtAdditiveParams, ampfreq_scale_offset), FIELD_FLOAT},
+  [PROP_AMPFREQ_SCALE_EXP] = {G_STRUCT_OFFSET(GstBtAdditiveParams, ampfreq_scale_exp), FIELD_FLOAT},
+  [PROP_AMP_BOOST_CENTER] = {G_STRUCT_OFFSET(GstBtAdditiveParams, amp_boost_center), FIELD_FLOAT},
+  [PROP_AMP_BOOST_SHARPNESS] = {G_STRUCT_OFFSET(GstBtAdditiveParams, amp_boost_sharpness), FIELD_FLOAT},
+  [PROP_AMP_BOOST_EXP] = {G_STRUCT_OFFSET(GstBtAdditiveParams, amp_boost_exp), FIELD_FLOAT},
+  [PROP_AMP_BOOST_DB] = {G_STRUCT_OFFSET(GstBtAdditiveParams, amp_boost_db), FIELD_FLOAT},
+  [PROP_RINGMOD_RATE] = {G_STRUCT_OFFSET(GstBtAdditiveParams, ringmod_rate), FIELD_FLOAT},
+  [PROP_RINGMOD_DEPTH] = {G_STRUCT_OFFSET(GstBtAdditiveParams, ringmod_depth), FIELD_FLOAT},
+  [PROP_RINGMOD_OT_OFFSET] = {G_STRUCT_OFFSET(GstBtAdditiveParams, ringmod_ot_offset), FIELD_FLOAT},
+  [PROP_BEND] = {G_STRUCT_OFFSET(GstBtAdditiveParams, bend), FIELD_FLOAT},
+  [PROP_STEREO] = {G_STRUCT_OFFSET(GstBtAdditiveParams, stereo), FIELD_FLOAT},
+  [PROP_VIRTUAL_VOICES] = {G_STRUCT_OFFSET(GstBtAdditiveParams, n_virtual_voices), FIELD_UINT},
+  [PROP_VOL] = {G_STRUCT_OFFSET(GstBtAdditiveParams, vol), FIELD_FLOAT}
+};
+
 enum {
   PROP_CHILDREN = N_PROPERTIES_SRATE,
   PROP_OVERTONES,
   PROP_RELEASE_ON_NOTE,
   PROP_NOTE,
   PROP_ANTICLICK,
+  PROP_DITHER,
+  PROP_INTERNAL_BLOCK_FRAMES,
+  PROP_CONTROL_RATE_DIVISOR,
+  PROP_PARTIAL_RAMP_FRAMES,
+#ifdef USE_DEBUG
+  PROP_RT_ALLOCATIONS,
+#endif
   N_PROPERTIES
 };
 
@@ -141,14 +386,23 @@ static GParamSpec* properties[N_PROPERTIES] = { NULL, };
 static GObject* child_proxy_get_child_by_index (GstChildProxy *child_proxy, guint index) {
   GstBtAdditive* self = GSTBT_ADDITIVE(child_proxy);
 
-  g_return_val_if_fail(index < MAX_VOICES, NULL);
+  g_mutex_lock(&self->params_lock);
+  const Resources* const res = self->params_edit.resources;
+  GObject* const result = index < res->n_voices ? gst_object_ref(res->voices[index]) : NULL;
+  g_mutex_unlock(&self->params_lock);
 
-  return gst_object_ref(self->voices[index]);
+  g_return_val_if_fail(result, NULL);
+  return result;
 }
 
 static guint child_proxy_get_children_count (GstChildProxy *child_proxy) {
   GstBtAdditive* self = GSTBT_ADDITIVE(child_proxy);
-  return self->n_voices;
+
+  g_mutex_lock(&self->params_lock);
+  const guint result = self->params_edit.n_voices;
+  g_mutex_unlock(&self->params_lock);
+
+  return result;
 }
 
 static void child_proxy_interface_init (gpointer g_iface, gpointer iface_data) {
@@ -173,6 +427,10 @@ static gboolean plugin_init(GstPlugin * plugin) {
     GST_DEBUG_FG_WHITE | GST_DEBUG_BG_BLACK,
     GST_MACHINE_DESC);
 
+  // Applications can create the envelope and LFO by name, to drive other elements' properties as control sources.
+  g_type_ensure(gstbt_adsr_get_type());
+  g_type_ensure(gstbt_lfo_float_get_type());
+
   return gst_element_register(
     plugin,
     GST_MACHINE_NAME,
@@ -188,472 +446,1759 @@ GST_PLUGIN_DEFINE(
   plugin_init, VERSION, "GPL", PACKAGE_NAME, PACKAGE_BUGREPORT)
 
 
-static void _set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec) {
-  GstBtAdditive *self = GSTBT_ADDITIVE (object);
+// Forgets the ramp state of the overtones rendered in the last tile, so their next ramps start from their targets.
+static void overtones_ramp_unprime(StateVirtualVoice* const vvoice) {
+  for (guint i = 0; i < vvoice->overtones_ramp_primed; ++i) {
+    vvoice->states_overtone[i].ramp_primed = FALSE;
+  }
+  vvoice->overtones_ramp_primed = 0;
+}
 
-  switch (prop_id) {
-  case PROP_CHILDREN:
-    self->n_voices = g_value_get_ulong(value);
-    break;
-  case PROP_NOTE: {
-    GstBtNote note = g_value_get_enum(value);
-    if (note == GSTBT_NOTE_OFF) {
-      guint idx_last_virtual_voice =
-        self->n_virtual_voices > 1 ?
-        ((self->idx_next_virtual_voice - 1) + self->n_virtual_voices) % self->n_virtual_voices :
-        0;
-      
-      StateVirtualVoice* vvoice = &self->virtual_voices[idx_last_virtual_voice];
-      for (guint i = 0; i < self->n_voices; ++i) {
-        gstbt_additivev_note_off(vvoice->voices[i], self->parent.running_time);
-      }
-    } else if (note != GSTBT_NOTE_NONE) {
-      if (self->n_virtual_voices > 1 && self->release_on_note) {
-        const guint idx_last_virtual_voice =
-          ((self->idx_next_virtual_voice - 1) + self->n_virtual_voices) % self->n_virtual_voices;
-        
-        StateVirtualVoice* vvoice = &self->virtual_voices[idx_last_virtual_voice];
-        for (guint i = 0; i < self->n_voices; ++i) {
-          gstbt_additivev_note_off(vvoice->voices[i], self->parent.running_time);
-        }
+// The buffers used for rendering live in one arena, so that they're allocated in property setters rather than while
+// rendering, and so that the buffers used together are adjacent. The arena holds the staging block, then each
+// virtual voice's s-rate, control point and tile buffers followed by the buffers of each of its voices.
+//
+// Voices are only created while children and virtual-voices ask for them, so that an instance that plays a few of them
+// stays small. Every virtual voice has its own copy of each master voice, following the master's parameters. As
+// virtual-voices makes and frees voices, it isn't controllable, so that automation never does that while rendering.
+//
+// Rendering may be using the voices and the arena at any time, so a setter that changes them makes new Resources,
+// sharing the voices that stay, and publishes them with the parameters. Rendering moves to the new resources at the
+// start of a block and publishes their serial. Resources are only replaced by newer ones, so once rendering has
+// published a serial it's finished with every older set, and the next setter to change them frees them along with the
+// voices that their replacements dropped. Making and freeing voices is slow, so it's done without "params_lock",
+// which rendering takes for its controller syncs.
+
+static gsize arena_align(const gsize size) {
+  return (size + ARENA_ALIGN - 1) & ~(gsize)(ARENA_ALIGN - 1);
+}
+
+static gsize arena_staging_size(const guint block_frames) {
+  return arena_align(block_frames * MAX_FRAME_SIZE);
+}
+
+static gsize arena_srate_size(void) {
+  return arena_align(sizeof(gfloat) * TILE_FRAMES * (N_PROPERTIES_SRATE-1));
+}
+
+static gsize arena_tile_size(void) {
+  return arena_align(sizeof(gfloat) * TILE_FRAMES * 2);
+}
+
+static gsize arena_voice_size(void) {
+  return gstbt_additivev_buffers_size(TILE_FRAMES, ARENA_ALIGN);
+}
+
+static gsize arena_vvoice_size(const guint n_voices) {
+  return 2 * arena_srate_size() + arena_tile_size() + n_voices * arena_voice_size();
+}
+
+static guint8* arena_vvoice(const Resources* const res, const guint idx_vvoice) {
+  return res->base + arena_staging_size(res->block_frames) + idx_vvoice * arena_vvoice_size(res->n_voices);
+}
+
+static guint8* arena_voice(const Resources* const res, const guint idx_vvoice, const guint idx_voice) {
+  return arena_vvoice(res, idx_vvoice) + arena_vvoice_size(0) + idx_voice * arena_voice_size();
+}
+
+static GstBtAdditiveV* voice_new(GstBtAdditive* const self, const guint idx_voice, const char* const name) {
+  GstBtAdditiveV* const voice = gstbt_additivev_new(&properties[1], N_PROPERTIES_SRATE, idx_voice);
+  gst_object_set_name((GstObject*)voice, name);
+  gst_object_set_parent((GstObject*)voice, (GstObject*)self);
+  return voice;
+}
+
+// Frees "res", and the voices that aren't in the resources that replaced it.
+static void resources_free(Resources* const res) {
+  const guint n_voices_kept = res->next ? res->next->n_voices : 0;
+  const guint n_vvoices_kept = res->next ? res->next->n_vvoices : 0;
+  
+  // The copies refer to the master's parameters, so they go first. Unparenting drops the last reference.
+  for (guint j = 0; j < res->n_vvoices; ++j) {
+    for (guint i = j < n_vvoices_kept ? n_voices_kept : 0; i < res->n_voices; ++i)
+      gst_object_unparent((GstObject*)res->vvoice_voices[j][i]);
+  }
+  
+  for (guint i = n_voices_kept; i < res->n_voices; ++i)
+    gst_object_unparent((GstObject*)res->voices[i]);
+  
+  g_free(res->mem);
+  g_free(res);
+}
+
+// Unlinks the resources that rendering has finished with. Returns the oldest of them, which lead through "next" to
+// the rest, and sets "n_retired" to how many there are. Must be called with "resources_lock" held.
+static Resources* resources_retire(GstBtAdditive* const self, guint* const n_retired) {
+  const guint adopted = __atomic_load_n(&self->resources_adopted, __ATOMIC_ACQUIRE);
+  Resources* const retired = self->resources_oldest;
+  
+  *n_retired = 0;
+  while (self->resources_oldest != self->params_edit.resources && self->resources_oldest->serial < adopted) {
+    self->resources_oldest = self->resources_oldest->next;
+    ++*n_retired;
+  }
+
+  return retired;
+}
+
+// Frees the "n" resources from "retired" onwards, which resources_retire returned. Each set's voices that the next one
+// dropped are found through "next", so this must be called with "resources_lock" held, so that the sets that replaced
+// them stay put.
+static void resources_free_retired(Resources* retired, guint n) {
+  for (; n > 0; --n) {
+    Resources* const res = retired;
+    retired = res->next;
+    resources_free(res);
+  }
+}
+
+// Makes resources for "n_voices" voices in each of "n_vvoices" virtual voices and a staging block of "block_frames",
+// sharing the voices of "old" that stay, or returns NULL if "old" already fits. Must be called with "resources_lock"
+// held. The new resources aren't used until resources_update publishes them.
+static Resources* resources_new(GstBtAdditive* const self, const Resources* const old, const guint n_voices,
+                                const guint n_vvoices, const guint block_frames) {
+  if (old && n_voices == old->n_voices && n_vvoices == old->n_vvoices && block_frames == old->block_frames)
+    return NULL;
+
+  GST_DEBUG_OBJECT(self, "Resources for %u voices, %u virtual voices, block %u", n_voices, n_vvoices, block_frames);
+  
+  Resources* const res = g_new0(Resources, 1);
+  const gsize size = arena_staging_size(block_frames) + n_vvoices * arena_vvoice_size(n_voices);
+  res->mem = g_malloc0(size + ARENA_ALIGN);
+  res->base = (guint8*)arena_align((guintptr)res->mem);
+  res->n_voices = n_voices;
+  res->n_vvoices = n_vvoices;
+  res->block_frames = block_frames;
+
+  const guint n_voices_old = old ? old->n_voices : 0;
+  const guint n_vvoices_old = old ? old->n_vvoices : 0;
+  char name[16];
+  
+  for (guint i = 0; i < n_voices; ++i) {
+    if (i < n_voices_old) {
+      res->voices[i] = old->voices[i];
+    } else {
+      g_snprintf(name, sizeof(name), "voice%u", i);
+      res->voices[i] = voice_new(self, i, name);
+    }
+  }
+  
+  for (guint j = 0; j < n_vvoices; ++j) {
+    for (guint i = 0; i < n_voices; ++i) {
+      if (j < n_vvoices_old && i < n_voices_old) {
+        res->vvoice_voices[j][i] = old->vvoice_voices[j][i];
+      } else {
+        g_snprintf(name, sizeof(name), "voice%u_%u", j, i);
+        res->vvoice_voices[j][i] = voice_new(self, i, name);
+        gstbt_additivev_share_params(res->vvoice_voices[j][i], res->voices[i]);
       }
-      
-      StateVirtualVoice* vvoice = &self->virtual_voices[self->idx_next_virtual_voice];
-      self->idx_next_virtual_voice = (self->idx_next_virtual_voice + 1) % self->n_virtual_voices;
+    }
+  }
+
+  res->serial = old ? old->serial + 1 : 1;
+  return res;
+}
+
+// Moves rendering to the voices and buffers of the parameters just taken, if they're new. Staged frames are kept if the
+// block size is unchanged. Only called on the streaming thread.
+static void resources_adopt(GstBtAdditive* const self) {
+  const Resources* const res = self->params->resources;
+  const Resources* const old = self->resources;
+  
+  if (res == old)
+    return;
+
+  if (old && old->block_frames == res->block_frames)
+    memcpy(res->base, old->base, arena_staging_size(res->block_frames));
+  else
+    self->staging_offset = self->staging_frames;
+  
+  self->staging = res->block_frames ? res->base : NULL;
+  
+  for (guint i = 0; i < MAX_VOICES; ++i)
+    self->voices[i] = i < res->n_voices ? res->voices[i] : NULL;
+  
+  for (guint j = 0; j < MAX_VIRTUAL_VOICES; ++j) {
+    StateVirtualVoice* const vvoice = &self->virtual_voices[j];
+    
+    // Virtual voices beyond virtual-voices aren't rendered, and have no buffers or voices.
+    if (j >= res->n_vvoices) {
+      vvoice->buf_srate_props = vvoice->buf_ctrl = vvoice->buf_tile = NULL;
+      memset(vvoice->voices, 0, sizeof(vvoice->voices));
+      continue;
+    }
+    
+    guint8* const mem = arena_vvoice(res, j);
     
-      self->note = note;
-      vvoice->note = note;
-      for (guint i = 0; i < self->n_voices; ++i) {
-        gstbt_additivev_note_on(vvoice->voices[i], self->parent.running_time, self->anticlick);
+    vvoice->buf_srate_props = (gfloat*)mem;
+    vvoice->buf_ctrl = (gfloat*)(mem + arena_srate_size());
+    vvoice->buf_tile = (gfloat*)(mem + 2 * arena_srate_size());
+    
+    for (guint i = 0; i < MAX_VOICES; ++i) {
+      if (i < res->n_voices) {
+        vvoice->voices[i] = res->vvoice_voices[j][i];
+        gstbt_additivev_buffers_set(vvoice->voices[i], TILE_FRAMES, ARENA_ALIGN, arena_voice(res, j, i));
+      } else {
+        vvoice->voices[i] = NULL;
       }
     }
+  }
+
+  self->resources = res;
+  __atomic_store_n(&self->resources_adopted, res->serial, __ATOMIC_RELEASE);
+}
+
+// Publishes "params_edit" for rendering to take. Must be called with "params_lock" held.
+static void params_publish(GstBtAdditive* const self) {
+  self->params_slots[self->params_back] = self->params_edit;
+  self->params_back =
+    __atomic_exchange_n(&self->params_shared, self->params_back | PARAMS_FRESH, __ATOMIC_ACQ_REL) & ~PARAMS_FRESH;
+}
+
+// Sets the voice and virtual voice counts and the block size, and publishes resources to match. The resources are made and the retired ones
+// freed without "params_lock", so that a change from the application never holds up rendering's controller syncs.
+// Must be called with "resources_lock" held.
+static void resources_update(GstBtAdditive* const self, const guint n_voices, const guint n_vvoices,
+                             const guint block_frames) {
+  GstBtAdditiveParams* const params = &self->params_edit;
+  
+  // The fields read here are only written with "resources_lock" held.
+  Resources* const old = params->resources;
+  Resources* const res = resources_new(self, old, n_voices, n_vvoices, block_frames);
+
+  if (res) {
+    if (old)
+      old->next = res;
+    else
+      self->resources_oldest = res;
+  }
+
+  // The voices are made before rendering is told about them.
+  g_mutex_lock(&self->params_lock);
+  if (res)
+    params->resources = res;
+  params->n_voices = n_voices;
+  if (n_vvoices != params->n_virtual_voices) {
+    params->n_virtual_voices = n_vvoices;
+    ++params->resets[RESET_VVOICES];
+  }
+  params->block_frames = block_frames;
+  params_publish(self);
+  g_mutex_unlock(&self->params_lock);
+
+  guint n_retired;
+  Resources* const retired = resources_retire(self, &n_retired);
+  resources_free_retired(retired, n_retired);
+}
+
+// Sets children, virtual-voices or internal-block-frames, which decide the resources.
+static void resources_set(GstBtAdditive* const self, const guint prop_id, const GValue* const value) {
+  const GstBtAdditiveParams* const params = &self->params_edit;
+  
+  g_mutex_lock(&self->resources_lock);
+  
+  guint n_voices = params->n_voices;
+  guint n_vvoices = params->n_virtual_voices;
+  guint block_frames = params->block_frames;
+  switch (prop_id) {
+  case PROP_CHILDREN:
+    n_voices = g_value_get_ulong(value);
+    break;
+  case PROP_VIRTUAL_VOICES:
+    n_vvoices = g_value_get_uint(value);
+    break;
+  default:
+    block_frames = g_value_get_uint(value);
     break;
   }
+  
+  const gboolean block_changed = block_frames != params->block_frames;
+  resources_update(self, n_voices, n_vvoices, block_frames);
+  
+  g_mutex_unlock(&self->resources_lock);
+
+  // Not posted under the locks, as it can lead straight to a latency query.
+  if (block_changed)
+    gst_element_post_message((GstElement*)self, gst_message_new_latency((GstObject*)self));
+}
+
+// Takes the last published parameters for rendering, if they're new, moves to their resources and does any resets
+// they ask for. Only called on the streaming thread.
+static void params_acquire(GstBtAdditive* const self) {
+  if (__atomic_load_n(&self->params_shared, __ATOMIC_ACQUIRE) & PARAMS_FRESH) {
+    self->params_front =
+      __atomic_exchange_n(&self->params_shared, self->params_front, __ATOMIC_ACQ_REL) & ~PARAMS_FRESH;
+    self->params = &self->params_slots[self->params_front];
+  }
+
+  const GstBtAdditiveParams* const params = self->params;
+  resources_adopt(self);
+  
+  if (params->resets[RESET_RINGMOD_PHASE] != self->resets_done[RESET_RINGMOD_PHASE]) {
+    const gfloat offset = params->ringmod_ot_offset * F2PI;
+    for (int j = 0; j < MAX_VIRTUAL_VOICES; ++j) {
+      for (int i = 0; i < MAX_OVERTONES; ++i) {
+        self->virtual_voices[j].states_overtone[i].accum_rads = offset;
+        self->virtual_voices[j].states_overtone[i].accum_rm_rads = offset;
+      }
+    }
+  }
+  
+  if (params->resets[RESET_CTRL] != self->resets_done[RESET_CTRL]) {
+    for (guint i = 0; i < MAX_VIRTUAL_VOICES; ++i) {
+      self->virtual_voices[i].ctrl_pos = 0;
+      self->virtual_voices[i].ctrl_primed = FALSE;
+    }
+  }
+  
+  if (params->resets[RESET_RAMPS] != self->resets_done[RESET_RAMPS]) {
+    for (guint i = 0; i < MAX_VIRTUAL_VOICES; ++i) {
+      overtones_ramp_unprime(&self->virtual_voices[i]);
+    }
+  }
+
+  if (params->resets[RESET_VVOICES] != self->resets_done[RESET_VVOICES]) {
+    for (guint i = params->n_virtual_voices; i < MAX_VIRTUAL_VOICES; ++i) {
+      self->virtual_voices[i].ctrl_pos = 0;
+      self->virtual_voices[i].ctrl_primed = FALSE;
+      overtones_ramp_unprime(&self->virtual_voices[i]);
+    }
+  }
+
+  memcpy(self->resets_done, params->resets, sizeof(self->resets_done));
+}
+
+// Sets a property held in GstBtAdditiveParams, and publishes the change.
+static void params_set(GstBtAdditive* const self, guint prop_id, const GValue* const value, GParamSpec* const pspec) {
+  GstBtAdditiveParams* const params = &self->params_edit;
+  
+  g_mutex_lock(&self->params_lock);
+  
+  switch (prop_id) {
   case PROP_OVERTONES:
-    self->overtones = g_value_get_uint(value);
+    params->overtones = g_value_get_uint(value);
     break;
   case PROP_FREQ_MAX:
-    self->freq_max = g_value_get_float(value);
+    params->freq_max = g_value_get_float(value);
     break;
   case PROP_SUM_START_IDX:
-    self->sum_start_idx = g_value_get_int(value);
+    params->sum_start_idx = g_value_get_int(value);
     break;
   case PROP_AMP_POW_BASE:
-    self->amp_pow_base = g_value_get_float(value);
+    params->amp_pow_base = g_value_get_float(value);
     break;
   case PROP_AMP_EXP_IDX_MUL:
-    self->amp_exp_idx_mul = g_value_get_float(value);
+    params->amp_exp_idx_mul = g_value_get_float(value);
     break;
   case PROP_AMPFREQ_SCALE_IDX_MUL:
-    self->ampfreq_scale_idx_mul = g_value_get_float(value);
+    params->ampfreq_scale_idx_mul = g_value_get_float(value);
     break;
   case PROP_AMPFREQ_SCALE_OFFSET:
-    self->ampfreq_scale_offset = g_value_get_float(value);
+    params->ampfreq_scale_offset = g_value_get_float(value);
     break;
   case PROP_AMPFREQ_SCALE_EXP:
-    self->ampfreq_scale_exp = g_value_get_float(value);
+    params->ampfreq_scale_exp = g_value_get_float(value);
     break;
   case PROP_AMP_BOOST_CENTER:
-    self->amp_boost_center = g_value_get_float(value);
+    params->amp_boost_center = g_value_get_float(value);
     break;
   case PROP_AMP_BOOST_SHARPNESS:
-    self->amp_boost_sharpness = g_value_get_float(value);
+    params->amp_boost_sharpness = g_value_get_float(value);
     break;
   case PROP_AMP_BOOST_EXP:
-    self->amp_boost_exp = g_value_get_float(value);
+    params->amp_boost_exp = g_value_get_float(value);
     break;
   case PROP_AMP_BOOST_DB:
-    self->amp_boost_db = g_value_get_float(value);
+    params->amp_boost_db = g_value_get_float(value);
     break;
   case PROP_RINGMOD_RATE:
-    self->ringmod_rate = g_value_get_float(value);
+    params->ringmod_rate = g_value_get_float(value);
     break;
   case PROP_RINGMOD_DEPTH:
-    self->ringmod_depth = g_value_get_float(value);
+    params->ringmod_depth = g_value_get_float(value);
     break;
   case PROP_RINGMOD_OT_OFFSET:
-    self->ringmod_ot_offset = g_value_get_float(value);
-    self->ringmod_ot_offset_calc = self->ringmod_ot_offset * F2PI;
-    for (int j = 0; j < MAX_VIRTUAL_VOICES; ++j) {
-      for (int i = 0; i < MAX_OVERTONES; ++i) {
-        self->virtual_voices[j].states_overtone[i].accum_rads = self->ringmod_ot_offset_calc;
-        self->virtual_voices[j].states_overtone[i].accum_rm_rads = self->ringmod_ot_offset_calc;
-      }
-    }
+    params->ringmod_ot_offset = g_value_get_float(value);
+    ++params->resets[RESET_RINGMOD_PHASE];
     break;
   case PROP_BEND:
-    self->bend = g_value_get_float(value);
+    params->bend = g_value_get_float(value);
     break;
   case PROP_STEREO:
-    self->stereo = g_value_get_float(value);
-    break;
-  case PROP_VIRTUAL_VOICES:
-    self->n_virtual_voices = g_value_get_uint(value);
+    params->stereo = g_value_get_float(value);
     break;
   case PROP_RELEASE_ON_NOTE:
-    self->release_on_note = g_value_get_boolean(value);
+    params->release_on_note = g_value_get_boolean(value);
     break;
   case PROP_VOL:
-    self->vol = g_value_get_float(value);
+    params->vol = g_value_get_float(value);
     break;
   case PROP_ANTICLICK:
-    self->anticlick = g_value_get_float(value);
+    params->anticlick = g_value_get_float(value);
+    break;
+  case PROP_DITHER:
+    params->dither = g_value_get_boolean(value);
+    break;
+  case PROP_CONTROL_RATE_DIVISOR:
+    params->control_rate_divisor = g_value_get_uint(value);
+    ++params->resets[RESET_CTRL];
+    break;
+  case PROP_PARTIAL_RAMP_FRAMES:
+    // Round up to a whole number of groups of 4.
+    params->partial_ramp_frames = (g_value_get_uint(value) + 3) & ~3u;
+    ++params->resets[RESET_RAMPS];
     break;
   default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (self, prop_id, pspec);
+    break;
+  }
+
+  params_publish(self);
+  g_mutex_unlock(&self->params_lock);
+}
+
+// Queues "note" to be played at running time "time". Notes whose time has passed, and those with a time of
+// GST_CLOCK_TIME_NONE, are played at the start of the next block rendered.
+static void events_push(GstBtAdditive* const self, const GstClockTime time, const GstBtNote note) {
+  g_mutex_lock(&self->events_lock);
+  
+  const guint head = self->events_head;
+  if (head - __atomic_load_n(&self->events_tail, __ATOMIC_ACQUIRE) < MAX_EVENTS) {
+    self->events[head % MAX_EVENTS] = (Event){.time = time, .note = note};
+    __atomic_store_n(&self->events_head, head + 1, __ATOMIC_RELEASE);
+  } else {
+    GST_WARNING_OBJECT(self, "Too many notes waiting to be played, dropping note %d", note);
+  }
+  
+  g_mutex_unlock(&self->events_lock);
+}
+
+// Moves queued notes into events_pending, in time order. Notes at the same time stay in the order they were queued.
+static void events_take(GstBtAdditive* const self) {
+  const guint head = __atomic_load_n(&self->events_head, __ATOMIC_ACQUIRE);
+  guint tail = self->events_tail;
+
+  for (; tail != head && self->n_events_pending < MAX_EVENTS; ++tail) {
+    Event event = self->events[tail % MAX_EVENTS];
+    // Notes with no time are due now, ahead of the rest.
+    if (!GST_CLOCK_TIME_IS_VALID(event.time))
+      event.time = 0;
+    
+    guint i = self->n_events_pending++;
+    for (; i > 0 && self->events_pending[i-1].time > event.time; --i)
+      self->events_pending[i] = self->events_pending[i-1];
+    self->events_pending[i] = event;
+  }
+
+  __atomic_store_n(&self->events_tail, tail, __ATOMIC_RELEASE);
+}
+
+// Plays a note, starting or releasing the envelopes of a virtual voice at running time "time".
+static void event_apply(GstBtAdditive* const self, const Event* const event, const GstClockTime time) {
+  const guint n_vvoices = self->params->n_virtual_voices;
+  const guint n_voices = self->params->n_voices;
+  
+  // The virtual voices can be reduced between notes.
+  if (self->idx_next_virtual_voice >= n_vvoices)
+    self->idx_next_virtual_voice = 0;
+  
+  if (event->note == GSTBT_NOTE_OFF) {
+    guint idx_last_virtual_voice =
+      n_vvoices > 1 ?
+      ((self->idx_next_virtual_voice - 1) + n_vvoices) % n_vvoices :
+      0;
+      
+    StateVirtualVoice* vvoice = &self->virtual_voices[idx_last_virtual_voice];
+    for (guint i = 0; i < n_voices; ++i) {
+      gstbt_additivev_note_off(vvoice->voices[i], time);
+    }
+  } else if (event->note != GSTBT_NOTE_NONE) {
+    if (n_vvoices > 1 && self->params->release_on_note) {
+      const guint idx_last_virtual_voice =
+        ((self->idx_next_virtual_voice - 1) + n_vvoices) % n_vvoices;
+        
+      StateVirtualVoice* vvoice = &self->virtual_voices[idx_last_virtual_voice];
+      for (guint i = 0; i < n_voices; ++i) {
+        gstbt_additivev_note_off(vvoice->voices[i], time);
+      }
+    }
+      
+    StateVirtualVoice* vvoice = &self->virtual_voices[self->idx_next_virtual_voice];
+    self->idx_next_virtual_voice = (self->idx_next_virtual_voice + 1) % n_vvoices;
+    
+    vvoice->note = event->note;
+    for (guint i = 0; i < n_voices; ++i) {
+      gstbt_additivev_note_on(vvoice->voices[i], time, self->params->anticlick);
+    }
+  }
+}
+
+static void _set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec) {
+  GstBtAdditive *self = GSTBT_ADDITIVE (object);
+
+  switch (prop_id) {
+  case PROP_NOTE: {
+    const GstBtNote note = g_value_get_enum(value);
+    if (note != GSTBT_NOTE_NONE) {
+      if (note != GSTBT_NOTE_OFF)
+        self->note = note;
+      
+      // Notes from the controller are played at the time of the sync that set them, and others, such as from a UI,
+      // as soon as possible. The syncs are done on the streaming thread: either by process, which gives their time,
+      // or by GstBtAudioSynth for the start of the buffer.
+      GstClockTime time = GST_CLOCK_TIME_NONE;
+      if (g_thread_self() == __atomic_load_n(&self->streaming_thread, __ATOMIC_RELAXED)) {
+        time = __atomic_load_n(&self->sync_running_time, __ATOMIC_RELAXED);
+        if (!GST_CLOCK_TIME_IS_VALID(time))
+          time = self->parent.running_time;
+      }
+      events_push(self, time, note);
+    }
+    break;
+  }
+  case PROP_CHILDREN:
+  case PROP_VIRTUAL_VOICES:
+  case PROP_INTERNAL_BLOCK_FRAMES:
+    resources_set(self, prop_id, value);
+    break;
+  default:
+    params_set(self, prop_id, value, pspec);
     break;
   }
 }
 
 static void _get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec) {
   GstBtAdditive *self = GSTBT_ADDITIVE (object);
+  const GstBtAdditiveParams* const params = &self->params_edit;
 
+  g_mutex_lock(&self->params_lock);
+  
   switch (prop_id) {
   case PROP_CHILDREN:
-    g_value_set_ulong(value, self->n_voices);
+    g_value_set_ulong(value, params->n_voices);
     break;
   case PROP_OVERTONES:
-    g_value_set_uint(value, self->overtones);
+    g_value_set_uint(value, params->overtones);
     break;
   case PROP_FREQ_MAX:
-    g_value_set_float(value, self->freq_max);
+    g_value_set_float(value, params->freq_max);
     break;
   case PROP_SUM_START_IDX:
-    g_value_set_int(value, self->sum_start_idx);
+    g_value_set_int(value, params->sum_start_idx);
     break;
   case PROP_AMP_POW_BASE:
-    g_value_set_float(value, self->amp_pow_base);
+    g_value_set_float(value, params->amp_pow_base);
     break;
   case PROP_AMP_EXP_IDX_MUL:
-    g_value_set_float(value, self->amp_exp_idx_mul);
+    g_value_set_float(value, params->amp_exp_idx_mul);
     break;
   case PROP_AMPFREQ_SCALE_IDX_MUL:
-    g_value_set_float(value, self->ampfreq_scale_idx_mul);
+    g_value_set_float(value, params->ampfreq_scale_idx_mul);
     break;
   case PROP_AMPFREQ_SCALE_OFFSET:
-    g_value_set_float(value, self->ampfreq_scale_offset);
+    g_value_set_float(value, params->ampfreq_scale_offset);
     break;
   case PROP_AMPFREQ_SCALE_EXP:
-    g_value_set_float(value, self->ampfreq_scale_exp);
+    g_value_set_float(value, params->ampfreq_scale_exp);
     break;
   case PROP_AMP_BOOST_CENTER:
-    g_value_set_float(value, self->amp_boost_center);
+    g_value_set_float(value, params->amp_boost_center);
     break;
   case PROP_AMP_BOOST_SHARPNESS:
-    g_value_set_float(value, self->amp_boost_sharpness);
+    g_value_set_float(value, params->amp_boost_sharpness);
     break;
   case PROP_AMP_BOOST_EXP:
-    g_value_set_float(value, self->amp_boost_exp);
+    g_value_set_float(value, params->amp_boost_exp);
     break;
   case PROP_AMP_BOOST_DB:
-    g_value_set_float(value, self->amp_boost_db);
+    g_value_set_float(value, params->amp_boost_db);
     break;
   case PROP_RINGMOD_RATE:
-    g_value_set_float(value, self->ringmod_rate);
+    g_value_set_float(value, params->ringmod_rate);
     break;
   case PROP_RINGMOD_DEPTH:
-    g_value_set_float(value, self->ringmod_depth);
+    g_value_set_float(value, params->ringmod_depth);
     break;
   case PROP_RINGMOD_OT_OFFSET:
-    g_value_set_float(value, self->ringmod_ot_offset);
+    g_value_set_float(value, params->ringmod_ot_offset);
     break;
   case PROP_BEND:
-    g_value_set_float(value, self->bend);
+    g_value_set_float(value, params->bend);
     break;
   case PROP_STEREO:
-    g_value_set_float(value, self->stereo);
+    g_value_set_float(value, params->stereo);
     break;
   case PROP_VIRTUAL_VOICES:
-    g_value_set_uint(value, self->n_virtual_voices);
+    g_value_set_uint(value, params->n_virtual_voices);
     break;
   case PROP_RELEASE_ON_NOTE:
-    g_value_set_boolean(value, self->release_on_note);
+    g_value_set_boolean(value, params->release_on_note);
     break;
   case PROP_VOL:
-    g_value_set_float(value, self->vol);
+    g_value_set_float(value, params->vol);
     break;
   case PROP_ANTICLICK:
-    g_value_set_float(value, self->anticlick);
+    g_value_set_float(value, params->anticlick);
+    break;
+  case PROP_DITHER:
+    g_value_set_boolean(value, params->dither);
+    break;
+  case PROP_INTERNAL_BLOCK_FRAMES:
+    g_value_set_uint(value, params->block_frames);
+    break;
+  case PROP_CONTROL_RATE_DIVISOR:
+    g_value_set_uint(value, params->control_rate_divisor);
     break;
+  case PROP_PARTIAL_RAMP_FRAMES:
+    g_value_set_uint(value, params->partial_ramp_frames);
+    break;
+#ifdef USE_DEBUG
+  case PROP_RT_ALLOCATIONS:
+    g_value_set_uint64(value, rt_check_live() ? rt_check_allocations(&self->rt_check) : G_MAXUINT64);
+    break;
+#endif
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     break;
   }
+
+  g_mutex_unlock(&self->params_lock);
 }
 
 static gfloat* srate_prop_buf_get(const GstBtAdditive* const self, const StateVirtualVoice* const vvoice, 
                                   AdditivePropsSrate prop) {
-  return vvoice->buf_srate_props + self->buf_samples/2 * ((guint)prop-1);
+  return vvoice->buf_srate_props + TILE_FRAMES * ((guint)prop-1);
 }
 
-static gboolean srate_prop_is_controlled(const StateVirtualVoice* const self, AdditivePropsSrate prop) {
-  return self->props_srate_controlled[(guint)prop-1];
+static const SrateBufDesc* srate_prop_desc(const StateVirtualVoice* const self, AdditivePropsSrate prop) {
+  return &self->srate_descs[(guint)prop-1];
 }
 
-static gboolean srate_prop_is_nonzero(const StateVirtualVoice* const self, AdditivePropsSrate prop) {
-  return self->props_srate_nonzero[(guint)prop-1];
+static gboolean srate_prop_is_const(const StateVirtualVoice* const self, AdditivePropsSrate prop) {
+  return srate_prop_desc(self, prop)->kind == SRATE_BUF_CONST;
 }
 
-static void srate_props_fill(GstBtAdditive* const self, StateVirtualVoice* const vvoice,
-                             const GstClockTime timestamp, const GstClockTime interval, const guint nframes) {
-  
-  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i) {
-    GValue src = G_VALUE_INIT;
-    g_value_init(&src, G_TYPE_FLOAT);
-    g_object_get_property((GObject*)self, properties[i]->name, &src);
-    
-    gfloat value = g_value_get_float(&src);
-    g_value_unset(&src);
+// TRUE if every frame of the property's s-rate buffer is known to be zero for this block.
+static gboolean srate_prop_is_zero(const StateVirtualVoice* const self, AdditivePropsSrate prop) {
+  return srate_buf_is_zero(srate_prop_desc(self, prop));
+}
 
-    gfloat* const sratebuf = srate_prop_buf_get(self, vvoice, i);
-    for (guint j = 0; j < nframes; ++j) {
-      sratebuf[j] = value;
-    }
-  }
+// Transfer curves from a property's value to the value used by the kernels.
+typedef enum {
+  PROP_MAPPING_LINEAR,   // Used as-is
+  PROP_MAPPING_EXP_HZ,   // 0..1 to 13.75Hz..22050Hz, exponentially
+  PROP_MAPPING_DB_BOOST, // Decibels to a gain, less one
+  PROP_MAPPING_SEMITONE  // Semitones to a frequency ratio
+} PropMapping;
+
+static const PropMapping prop_mappings[N_PROPERTIES_SRATE] = {
+  [PROP_FREQ_MAX] = PROP_MAPPING_EXP_HZ,
+  [PROP_AMP_BOOST_CENTER] = PROP_MAPPING_EXP_HZ,
+  [PROP_AMP_BOOST_DB] = PROP_MAPPING_DB_BOOST,
+  [PROP_BEND] = PROP_MAPPING_SEMITONE
+};
 
-  memset(vvoice->props_srate_nonzero, 0, sizeof(vvoice->props_srate_nonzero));
-  memset(vvoice->props_srate_controlled, 0, sizeof(vvoice->props_srate_controlled));
-  
-  for (guint i = 0; i < self->n_voices; ++i) {
-    gstbt_additivev_mod_value_array_f_for_prop(
-      vvoice->voices[i],
-      timestamp,
-      interval,
-      nframes,
-      vvoice->buf_srate_props,
-      vvoice->props_srate_nonzero,
-      vvoice->props_srate_controlled,
-      vvoice->voices
-      );
+static inline v4sf prop_map4(const PropMapping mapping, const v4sf x) {
+  switch (mapping) {
+  case PROP_MAPPING_EXP_HZ:
+    // Constant below is the solution to the equation 440*2**(-5+1*m)=22050 for m.
+    return 440*powb24f(-5 + x * 10.64713132180759f);
+  case PROP_MAPPING_DB_BOOST:
+    return db_to_gain4f(x) - 1;
+  case PROP_MAPPING_SEMITONE:
+    return powb24f(x/12.0f);
+  default:
+    return x;
   }
+}
 
-  // Anything that can be done here will save it being done per-overtone.
-  // Calculate values that differ from the initial value set in the property.
-  {
-    gfloat* const srate = srate_prop_buf_get(self, vvoice, PROP_AMP_BOOST_DB);
-    for (guint i = 0; i < nframes; ++i)
-      srate[i] = db_to_gain(srate[i]) - 1;
-  }
-  {
-    v4sf* const srate = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_FREQ_MAX);
-    for (guint i = 0; i < nframes/4; ++i)
-      // Constant below is the solution to the equation 440*2**(-5+1*m)=22050 for m.
-      srate[i] = 440*powb24f(-5 + srate[i] * 10.64713132180759f);
+// Applies a property's mapping to its s-rate buffer. A constant is mapped once, and only modulated buffers are
+// mapped in full.
+static void srate_prop_map(SrateBufDesc* const desc, gfloat* const buf, const guint n, const PropMapping mapping) {
+  if (mapping == PROP_MAPPING_LINEAR)
+    return;
+
+  if (desc->kind == SRATE_BUF_CONST) {
+    srate_buf_set_const(desc, buf, prop_map4(mapping, desc->value * V4SF_UNIT)[0]);
+    return;
   }
-  {
-    v4sf* const srate = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_BOOST_CENTER);
-    for (guint i = 0; i < nframes/4; ++i)
-      // Constant below is the solution to the equation 440*2**(-5+1*m)=22050 for m.
-      srate[i] = 440*powb24f(-5 + srate[i] * 10.64713132180759f);
+  
+  v4sf* const buf4 = (v4sf*)buf;
+  v4si any_nonzero = V4SI_ZERO;
+  for (guint i = 0; i < n4_ceil(n); ++i) {
+    buf4[i] = prop_map4(mapping, buf4[i]);
+    any_nonzero |= buf4[i] != V4SF_ZERO;
   }
+
+  desc->kind = SRATE_BUF_ARRAY;
+  desc->nonzero = !v4si_eq(any_nonzero, V4SI_ZERO);
 }
 
-static gboolean is_machine_silent(const GstBtAdditive* const self, const StateVirtualVoice* const vvoice) {
-  if (srate_prop_is_controlled(vvoice, PROP_VOL)) {
-    return !srate_prop_is_nonzero(vvoice, PROP_VOL);
-  } else {
-    return self->vol == 0;
+// Reads the value of every s-rate property from the parameters taken for the block.
+static void srate_props_base_read(GstBtAdditive* const self) {
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i) {
+    const glong offset = srate_prop_fields[i].offset;
+    switch (srate_prop_fields[i].type) {
+    case FIELD_INT:
+      self->props_srate_base[i] = (gfloat)G_STRUCT_MEMBER(gint, self->params, offset);
+      break;
+    case FIELD_UINT:
+      self->props_srate_base[i] = (gfloat)G_STRUCT_MEMBER(guint, self->params, offset);
+      break;
+    default:
+      self->props_srate_base[i] = G_STRUCT_MEMBER(gfloat, self->params, offset);
+    }
   }
 }
 
-static inline v4sf horizontal_accumulate(v4sf inc) {
-  v4sf result = {inc[0], inc[0] + inc[1], inc[0] + inc[1] + inc[2], inc[0] + inc[1] + inc[2] + inc[3]};
-  return result;
+static void srate_binding_clear(SrateBinding* const bound) {
+  g_clear_pointer(&bound->binding, gst_object_unref);
+  g_clear_pointer(&bound->source, gst_object_unref);
+  bound->n_values = 0;
 }
 
-static void fill_buffer_internal(GstBtAdditive* const self, StateVirtualVoice* const vvoice, GstBuffer* gstbuf,
-                                 v4sf* const buffer, int nframes) {
-  g_assert(nframes*2 % 4 == 0);
-
-  const int n4frames = nframes/4;
+// Brings the cached control bindings of the float s-rate properties up to date with the element's. The element's list
+// is walked under one lock, and a binding is only looked into when it's new. Called once per block.
+static void srate_bindings_update(GstBtAdditive* const self) {
+  GstControlBinding* found[N_PROPERTIES_SRATE] = { NULL, };
+  gboolean fallback[N_PROPERTIES_SRATE] = { FALSE, };
   
-  memset(buffer, 0, n4frames*2*sizeof(typeof(*buffer)));
+  GST_OBJECT_LOCK(self);
+  for (GList* node = GST_OBJECT(self)->control_bindings; node; node = node->next) {
+    GstControlBinding* const binding = node->data;
+    for (guint i = 1; i < N_PROPERTIES_SRATE; ++i) {
+      if (binding->pspec == properties[i] && srate_prop_fields[i].type == FIELD_FLOAT) {
+        found[i] = binding;
+        break;
+      }
+    }
+  }
+
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i) {
+    SrateBinding* const bound = &self->srate_bindings[i];
+    if (found[i] == bound->binding)
+      continue;
+    
+    srate_binding_clear(bound);
+    if (!found[i])
+      continue;
+
+    bound->binding = gst_object_ref(found[i]);
+    bound->read = SRATE_READ_BINDING;
+    if (GST_IS_DIRECT_CONTROL_BINDING(found[i])) {
+      g_object_get(found[i], "control-source", &bound->source, "absolute", &bound->absolute, NULL);
+      if (bound->source) {
+        bound->read = GSTBT_IS_PROP_SRATE_CONTROL_SOURCE(bound->source) ?
+          SRATE_READ_DIRECT_SRATE_CS : SRATE_READ_DIRECT;
+      }
+    }
+    fallback[i] = bound->read == SRATE_READ_BINDING;
+  }
+  GST_OBJECT_UNLOCK(self);
+
+  // Said once for each binding, when it's first seen.
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i) {
+    if (fallback[i]) {
+      GST_WARNING_OBJECT(self, "The control binding of \"%s\" isn't a direct binding with a control source, so it's "
+                         "read with gst_control_binding_get_value_array, which can allocate while rendering",
+                         properties[i]->name);
+    }
+  }
+}
+
+// Starts reading the control bindings for a span starting at "pts" and "running_time". Bindings aren't used if
+// there's no PTS to read them at.
+static void srate_bindings_begin(GstBtAdditive* const self, const GstClockTime pts, const GstClockTime running_time) {
+  self->srate_binding_offset = GST_CLOCK_DIFF(running_time, pts);
+  self->srate_bindings_timed = GST_CLOCK_TIME_IS_VALID(pts);
   
-  const gfloat rate = self->parent.info.rate;
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i)
+    self->srate_bindings[i].n_values = 0;
+}
 
-  srate_props_fill(self, vvoice, self->parent.running_time, GST_SECOND / rate, nframes);
+static void srate_bindings_release(GstBtAdditive* const self) {
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i)
+    srate_binding_clear(&self->srate_bindings[i]);
+}
 
-  if (is_machine_silent(self, vvoice)) {
+// Reads "n" values from the source of a direct binding into "bound->values4", and maps them to property "prop" as
+// GstDirectControlBinding does. Times with no control value keep the property's own value.
+static gboolean srate_binding_read_direct(GstBtAdditive* const self, const guint prop, SrateBinding* const bound,
+                                          const GstClockTime timestamp, const GstClockTime interval, const guint n) {
+  gfloat* const values = (gfloat*)bound->values4;
+  
+  if (bound->read == SRATE_READ_DIRECT_SRATE_CS) {
+    if (!gstbt_prop_srate_cs_get_value_array_f((GstBtPropSrateControlSource*)bound->source, timestamp, interval, n,
+                                               values)) {
+      return FALSE;
+    }
+  } else {
+    if (!gst_control_source_get_value_array(bound->source, timestamp, interval, n, self->srate_binding_scratch))
+      return FALSE;
+    for (guint i = 0; i < n; ++i)
+      values[i] = (gfloat)self->srate_binding_scratch[i];
+  }
+
+  const GParamSpecFloat* const pspec = G_PARAM_SPEC_FLOAT(properties[prop]);
+  const v4sf min = pspec->minimum * V4SF_UNIT;
+  const v4sf max = pspec->maximum * V4SF_UNIT;
+  const v4sf base = self->props_srate_base[prop] * V4SF_UNIT;
+  
+  for (guint i = 0; i < n4_ceil(n); ++i) {
+    const v4sf s = bound->values4[i];
+    const v4sf v = bound->absolute ? clamp4f(s, min, max) : lerp4f(min, max, clamp4f(s, V4SF_ZERO, V4SF_UNIT));
+    // NaN marks a time with no value.
+    bound->values4[i] = bitselect4f(s == s, v, base);
+  }
+  
+  return TRUE;
+}
+
+// Reads "n" values of s-rate property "prop" from its control binding into "buf", if it has one. The values are
+// kept, so the other virtual voices evaluating the same frames needn't read them again.
+static gboolean srate_binding_read(GstBtAdditive* const self, const guint prop, gfloat* const buf,
+                                   SrateBufDesc* const desc, const GstClockTime timestamp,
+                                   const GstClockTime interval, const guint n) {
+  SrateBinding* const bound = &self->srate_bindings[prop];
+  if (!bound->binding || !self->srate_bindings_timed || gst_control_binding_is_disabled(bound->binding))
+    return FALSE;
+
+  if (bound->n_values != n || bound->timestamp != timestamp || bound->interval != interval) {
+    const GstClockTime stream_time = timestamp + self->srate_binding_offset;
+    
+    bound->n_values = 0;
+    if (bound->read == SRATE_READ_BINDING) {
+      if (!gst_control_binding_get_value_array(bound->binding, stream_time, interval, n, bound->values4))
+        return FALSE;
+    } else if (!srate_binding_read_direct(self, prop, bound, stream_time, interval, n)) {
+      return FALSE;
+    }
+    bound->timestamp = timestamp;
+    bound->interval = interval;
+    bound->n_values = n;
+  }
+
+  memcpy(buf, bound->values4, sizeof(gfloat) * n);
+  srate_buf_set_array(desc, buf, n);
+  desc->controlled = FALSE;
+  return TRUE;
+}
+
+// Evaluates "n" values of every s-rate property, with modulation from the voices applied, into "buf" and "descs".
+// "buf" has the same layout as buf_srate_props.
+static void srate_props_eval(GstBtAdditive* const self, StateVirtualVoice* const vvoice, gfloat* const buf,
+                             SrateBufDesc* const descs, const GstClockTime timestamp, const GstClockTime interval,
+                             const guint n) {
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i) {
+    // Unless the property is automated or a voice modulates it, its buffer is never written beyond the first group.
+    gfloat* const prop_buf = buf + TILE_FRAMES * (i-1);
+    if (!srate_binding_read(self, i, prop_buf, &descs[i-1], timestamp, interval, n))
+      srate_buf_init_const(&descs[i-1], prop_buf, self->props_srate_base[i]);
+  }
+
+  for (guint i = 0; i < self->params->n_voices; ++i) {
+    gstbt_additivev_mod_value_array_f_for_prop(
+      vvoice->voices[i],
+      timestamp,
+      interval,
+      n,
+      buf,
+      descs,
+      vvoice->voices
+      );
+  }
+
+  // Anything that can be done here will save it being done per-overtone.
+  for (guint i = 1; i < N_PROPERTIES_SRATE; ++i)
+    srate_prop_map(&descs[i-1], buf + TILE_FRAMES * (i-1), n, prop_mappings[i]);
+}
+
+// Fills the s-rate property buffers for a tile of "nframes".
+//
+// With a control-rate-divisor of N above 1, the properties are only evaluated every N frames and the values between
+// are linearly interpolated. Each control point is the end of a ramp that starts when it's evaluated, so modulation
+// lags by N frames. In exchange each control point is evaluated exactly once at evenly spaced times, regardless of
+// tile and buffer boundaries, so the LFOs' state advances exactly as it would at the full rate.
+static void srate_props_fill(GstBtAdditive* const self, StateVirtualVoice* const vvoice,
+                             const GstClockTime timestamp, const GstClockTime interval, const guint nframes) {
+  const guint divisor = self->params->control_rate_divisor;
+  
+  if (divisor == 1) {
+    srate_props_eval(self, vvoice, vvoice->buf_srate_props, vvoice->srate_descs, timestamp, interval, nframes);
     return;
   }
 
-  const gfloat freq_note = (gfloat)gstbt_tone_conversion_translate_from_number(self->tones, vvoice->note);
+  // Offset in the tile of the first control point, and the number of points in the tile.
+  const guint first = vvoice->ctrl_pos == 0 ? 0 : divisor - vvoice->ctrl_pos;
+  const guint n_points = first < nframes ? (nframes - 1 - first) / divisor + 1 : 0;
+
+  // Otherwise the descriptors from the last evaluation still apply.
+  if (n_points) {
+    srate_props_eval(self, vvoice, vvoice->buf_ctrl, vvoice->ctrl_descs, timestamp + first * interval,
+                     interval * divisor, n_points);
+  }
+
+  const gfloat step = 1.0f / divisor;
+  
+  for (guint p = 0; p < N_PROPERTIES_SRATE-1; ++p) {
+    const SrateBufDesc* const points_desc = &vvoice->ctrl_descs[p];
+    const gfloat* const points = vvoice->buf_ctrl + TILE_FRAMES * p;
+    SrateBufDesc* const desc = &vvoice->srate_descs[p];
+    gfloat* const out = vvoice->buf_srate_props + TILE_FRAMES * p;
+    gfloat from = vvoice->ctrl_from[p];
+    gfloat to = vvoice->ctrl_to[p];
+    guint pos = vvoice->ctrl_pos;
+    guint idx_point = 0;
+    gboolean primed = vvoice->ctrl_primed;
+    gboolean any_nonzero = from != 0 || to != 0;
+    // Whether every ramp in the tile is flat, at the same value.
+    guint n_ramps = 0;
+    gboolean flat = TRUE;
+
+    for (guint i = 0; i < nframes;) {
+      if (pos == 0) {
+        // The very first point has nothing to ramp from.
+        const gfloat point = srate_buf_get(points_desc, points, idx_point++);
+        from = primed ? to : point;
+        to = point;
+        primed = TRUE;
+        any_nonzero = any_nonzero || to != 0;
+      }
 
-  v4sf* const srate_bend = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_BEND);
-  for (guint i = 0; i < n4frames; ++i) {
-    srate_bend[i] = freq_note * powb24f(srate_bend[i]/12.0f);
+      // Run to the next control point or the end of the tile.
+      const guint n = MIN(divisor - pos, nframes - i);
+      const gfloat delta = (to - from) * step;
+      for (guint j = 0; j < n; ++j)
+        out[i + j] = from + delta * (pos + j);
+
+      flat = flat && from == to && (n_ramps == 0 || out[0] == from);
+      ++n_ramps;
+      i += n;
+      pos = (pos + n) % divisor;
+    }
+
+    vvoice->ctrl_from[p] = from;
+    vvoice->ctrl_to[p] = to;
+
+    if (flat) {
+      srate_buf_set_const(desc, out, out[0]);
+    } else {
+      // The values past "nframes" in the last group of 4 are read, but mustn't affect anything.
+      for (guint i = nframes; i < n4_ceil(nframes)*4; ++i)
+        out[i] = out[nframes-1];
+
+      desc->kind = SRATE_BUF_ARRAY;
+      desc->nonzero = any_nonzero;
+    }
+    desc->controlled = points_desc->controlled;
   }
   
-  const v4sf* const srate_freq_max = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_FREQ_MAX);
-  const v4sf* const srate_ampfreq_scale_idx_mul = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMPFREQ_SCALE_IDX_MUL);
-  const v4sf* const srate_amp_boost_center = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_BOOST_CENTER);
-  const v4sf* const srate_amp_boost_sharpness = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_BOOST_SHARPNESS);
-  const v4sf* const srate_amp_boost_exp = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_BOOST_EXP);
-  const v4sf* const srate_amp_boost_db = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_BOOST_DB);
-  const v4sf* const srate_amp_pow_base = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_POW_BASE);
-  const v4sf* const srate_amp_exp_idx_mul = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMP_EXP_IDX_MUL);
-  const v4sf* const srate_ampfreq_scale_offset = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMPFREQ_SCALE_OFFSET);
-  const v4sf* const srate_ampfreq_scale_exp = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_AMPFREQ_SCALE_EXP);
-  const v4sf* const srate_ringmod_rate = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_RINGMOD_RATE);
-  const v4sf* const srate_ringmod_depth = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_RINGMOD_DEPTH);
-  const v4sf* const srate_stereo = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_STEREO);
+  vvoice->ctrl_pos = (vvoice->ctrl_pos + nframes) % divisor;
+  vvoice->ctrl_primed = vvoice->ctrl_primed || n_points > 0;
+}
+
+static gboolean is_machine_silent(const GstBtAdditive* const self, const StateVirtualVoice* const vvoice) {
+  return srate_prop_is_zero(vvoice, PROP_VOL);
+}
+
+static inline v4sf horizontal_accumulate(v4sf inc) {
+  v4sf result = {inc[0], inc[0] + inc[1], inc[0] + inc[1] + inc[2], inc[0] + inc[1] + inc[2] + inc[3]};
+  return result;
+}
+
+// The features of a block that select a specialised overtone kernel. Each kernel is compiled with its features as
+// constants so that the sample loop doesn't need to test for them.
+enum {
+  KERNEL_BOOST = 1 << 0,      // amp-boost-db is non-zero somewhere in the block
+  KERNEL_RINGMOD = 1 << 1,    // ringmod-rate is non-zero somewhere in the block
+  KERNEL_STEREO = 1 << 2,     // ringmod is active and the stereo offset splits the left and right channels
+  KERNEL_AMP_CONST = 1 << 3,  // the harmonic scale and amplitude don't change during the block
+  KERNEL_RAMP = 1 << 4,       // partial-ramp-frames is set
+  N_KERNELS = 1 << 5
+};
+
+// An s-rate property buffer as seen by the kernels. Constant buffers have a mask of zero, so every index reads the
+// first group.
+typedef struct {
+  const v4sf* buf;
+  guint mask;
+} KernelSrate;
+
+static inline v4sf srate_at(const KernelSrate srate, const guint i) {
+  return srate.buf[i & srate.mask];
+}
+
+static KernelSrate kernel_srate(const GstBtAdditive* const self, const StateVirtualVoice* const vvoice,
+                                AdditivePropsSrate prop) {
+  const KernelSrate result = {
+    (const v4sf*)srate_prop_buf_get(self, vvoice, prop),
+    srate_buf_mask(srate_prop_desc(vvoice, prop))
+  };
+  return result;
+}
+
+typedef struct {
+  KernelSrate freq_note_bent;
+  KernelSrate freq_max;
+  KernelSrate ampfreq_scale_idx_mul;
+  KernelSrate ampfreq_scale_offset;
+  KernelSrate ampfreq_scale_exp;
+  KernelSrate amp_boost_center;
+  KernelSrate amp_boost_sharpness;
+  KernelSrate amp_boost_exp;
+  KernelSrate amp_boost_db;
+  KernelSrate amp_pow_base;
+  KernelSrate amp_exp_idx_mul;
+  KernelSrate ringmod_rate;
+  KernelSrate ringmod_depth;
+  KernelSrate stereo;
+  gfloat secs_per_sample;
+  guint nframes;
+  guint n4frames;
+  guint ramp_frames;
+  // Lane of the last group that holds the tile's last frame. Lanes after it are rendered but never output.
+  guint idx_last;
+} KernelInput;
+
+typedef void (*OvertoneKernel)(const KernelInput* in, StateOvertone* overtone, gint j, v4sf* out_l, v4sf* out_r);
+
+// Reads the values at frames "first", "first+stride"... of an s-rate buffer into the lanes of a vector. Lanes whose
+// frame would be at or after "end" repeat the last valid frame.
+static inline v4sf gather4f(const KernelSrate srate, const guint first, const guint stride, const guint end) {
+  // The mask is all or nothing, so it works for indexing single values too.
+  const gfloat* const values = (const gfloat*)srate.buf;
+  const guint last = first + (end - 1 - first) / stride * stride;
+  const v4sf result = {
+    values[MIN(first, last) & srate.mask],
+    values[MIN(first + stride, last) & srate.mask],
+    values[MIN(first + stride * 2, last) & srate.mask],
+    values[MIN(first + stride * 3, last) & srate.mask]
+  };
+  return result;
+}
+
+// The overtone kernel for partial-ramp-frames. The tile is divided into segments of ramp_frames, and the overtone's
+// frequency and amplitude are evaluated only at the first frame of each. Over the segment they ramp linearly from
+// the previous segment's values to reach the new ones at the start of the next, so they lag by one segment. The
+// phase is the exact sum of the ramped per-sample increments, leaving just the phase, sine and multiply-add per
+// sample.
+static inline __attribute__((always_inline))
+void fill_overtone_ramp_inline(const KernelInput* const in, StateOvertone* const overtone, const gint j,
+                               v4sf* const out_l, v4sf* const out_r, const guint features) {
+  const gboolean boost = (features & KERNEL_BOOST) != 0;
+  const gboolean ringmod = (features & KERNEL_RINGMOD) != 0;
+  const gboolean stereo = (features & KERNEL_STEREO) != 0;
+  const gboolean amp_const = (features & KERNEL_AMP_CONST) != 0;
+  const guint ramp_frames = in->ramp_frames;
+  const guint n_segments = (in->nframes + ramp_frames - 1) / ramp_frames;
+  
+  g_assert(n_segments <= MAX_RAMP_SEGMENTS);
+
+  v4sf hscale_freq_const = V4SF_ZERO;
+  v4sf hscale_amp_const = V4SF_ZERO;
+  if (amp_const) {
+    hscale_freq_const =
+      srate_at(in->ampfreq_scale_idx_mul, 0) * (gfloat)j + srate_at(in->ampfreq_scale_offset, 0);
+    hscale_amp_const =
+      pow4f_method(srate_at(in->amp_pow_base, 0), (gfloat)j * srate_at(in->amp_exp_idx_mul, 0))
+      * pow4f_method(hscale_freq_const, srate_at(in->ampfreq_scale_exp, 0));
+  }
+
+  // The targets for each segment, evaluated for 4 segments at a time.
+  v4sf incs[MAX_RAMP_SEGMENTS/4];
+  v4sf amps[MAX_RAMP_SEGMENTS/4];
   
-  const gfloat secs_per_sample = 1.0f / rate;
+  for (guint k4 = 0; k4 < n4_ceil(n_segments); ++k4) {
+    const guint first = k4 * 4 * ramp_frames;
+#define GATHER(buf) gather4f(buf, first, ramp_frames, in->nframes)
+    const v4sf hscale_freq =
+      amp_const ? hscale_freq_const : GATHER(in->ampfreq_scale_idx_mul) * (gfloat)j + GATHER(in->ampfreq_scale_offset);
+    const v4sf freq_overtone = GATHER(in->freq_note_bent) * hscale_freq;
+    const v4si mute = (freq_overtone <= 0) | (freq_overtone > GATHER(in->freq_max));
+
+    v4sf amp;
+    if (amp_const) {
+      amp = hscale_amp_const;
+    } else {
+      amp =
+        pow4f_method(GATHER(in->amp_pow_base), (gfloat)j * GATHER(in->amp_exp_idx_mul))
+        * pow4f_method(hscale_freq, GATHER(in->ampfreq_scale_exp));
+    }
+
+    if (boost) {
+      amp += GATHER(in->amp_boost_db) * powpnz4f(window_sharp_cosine4(
+                                                   freq_overtone,
+                                                   GATHER(in->amp_boost_center),
+                                                   22050,
+                                                   GATHER(in->amp_boost_sharpness)),
+                                                 GATHER(in->amp_boost_exp)+FLT_MIN);
+    }
+#undef GATHER
+
+    // The phase keeps advancing while muted, as it does when rendering every sample.
+    incs[k4] = F2PI * freq_overtone * in->secs_per_sample;
+    amps[k4] = bitselect4f(mute, V4SF_ZERO, amp);
+  }
+
+  const v4sf lanes = {0, 1, 2, 3};
+  gfloat inc_from = overtone->ramp_primed ? overtone->ramp_inc : incs[0][0];
+  gfloat amp_from = overtone->ramp_primed ? overtone->ramp_amp : amps[0][0];
+  gfloat phase = overtone->accum_rads;
+  v4sf f_rm = overtone->accum_rm_rads * V4SF_UNIT;
   
-  for (int j = self->sum_start_idx, idx_o = 0; idx_o < self->overtones; ++j, ++idx_o) {
-    g_assert(idx_o < MAX_OVERTONES);
-    StateOvertone* const overtone = &vvoice->states_overtone[idx_o];
+  for (guint k = 0; k < n_segments; ++k) {
+    const guint first = k * ramp_frames;
+    const guint len = MIN(ramp_frames, in->nframes - first);
+    const gfloat inc_to = incs[k/4][k%4];
+    const gfloat amp_to = amps[k/4][k%4];
+    const gfloat inc_slope = (inc_to - inc_from) / len;
+    const gfloat amp_slope = (amp_to - amp_from) / len;
+    const gboolean silent = amp_from == 0 && amp_to == 0;
     
-	v4sf f = overtone->accum_rads * V4SF_UNIT;
-	v4sf f_rm = overtone->accum_rm_rads * V4SF_UNIT;
-
-    v4sf* buf4 = buffer;
-    for (int i = 0; i < n4frames; ++i) {
-      const v4sf hscale_freq = srate_ampfreq_scale_idx_mul[i] * (gfloat)j + srate_ampfreq_scale_offset[i];
-	  
-      const v4sf freq_note_bent = srate_bend[i];
-      const v4sf freq_overtone = freq_note_bent * hscale_freq;
-
-      // Update accumulators now so that they will still be updated even if a muted sample is skipped.
-      const v4sf time_to_rads = F2PI * freq_overtone;
-      const v4sf inc = time_to_rads * secs_per_sample;
-      const v4sf inc_rm = inc * srate_ringmod_depth[i];
-
-      f = horizontal_accumulate(inc) + f[3];
-      f_rm = horizontal_accumulate(inc_rm) + f_rm[3];
-
-      // Limit the number of overtones to reduce aliasing.
-	  const v4si mute_sample = (freq_overtone <= 0) | (freq_overtone > srate_freq_max[i]);
-
-      // broad check to save CPU
-      if (v4si_eq(mute_sample, V4SI_TRUE)) {
-		continue;
-      } else {
-        const v4sf amp_mute_sample = bitselect4f(mute_sample, V4SF_ZERO, V4SF_UNIT);
-	  
-        v4sf amp_boost = srate_amp_boost_db[i];
-	  
-        if (!v4sf_eq(amp_boost, V4SF_ZERO)) {
-          amp_boost *= powpnz4f(window_sharp_cosine4(
-                                  freq_overtone,
-                                  srate_amp_boost_center[i],
-                                  22050,
-                                  srate_amp_boost_sharpness[i]),
-                                srate_amp_boost_exp[i]+FLT_MIN);
-        }
-
-        const v4sf hscale_amp =
-          pow4f_method(srate_amp_pow_base[i], (gfloat)j * srate_amp_exp_idx_mul[i])
-          * pow4f_method(hscale_freq, srate_ampfreq_scale_exp[i])
-          ;
-
-        const v4sf sample = (amp_boost + hscale_amp) * amp_mute_sample * sin4f(f);
-      
-        v4sf sample_l;
-        v4sf sample_r;
-        if (!v4sf_eq(srate_ringmod_rate[i], V4SF_ZERO)) {
-          // Avoid zero input to powpnz here by adding FLT_MIN
-          sample_l = sample * powpnzsin4f(f_rm, srate_ringmod_rate[i]+FLT_MIN);
-          sample_r = sample * powpnzsin4f(f_rm+F2PI*srate_stereo[i], srate_ringmod_rate[i]+FLT_MIN);
-        } else {
-          sample_l = sample;
-          sample_r = sample;
-        }
+    for (guint i = first / 4; i < n4_ceil(first + len); ++i) {
+      // Frame index of each lane in the segment.
+      const v4sf n = (gfloat)(i*4 - first) + lanes;
+      const v4sf inc = inc_from + inc_slope * n;
+
+      // The ringmod accumulator is kept running when ringmod is off so that its phase is intact when it's re-enabled.
+      f_rm = horizontal_accumulate(inc * srate_at(in->ringmod_depth, i)) + f_rm[3];
+
+      if (silent)
+        continue;
+
+      // Phase after the increments of frames 0 to n inclusive: sum of inc_from + inc_slope*m for m = 0..n.
+      const v4sf f = phase + inc_from * (n + 1) + inc_slope * 0.5f * n * (n + 1);
+      const v4sf sample = (amp_from + amp_slope * n) * sin4f(f);
       
-        buf4[0][0] += sample_l[0];
-        buf4[0][1] += sample_r[0];
-        buf4[0][2] += sample_l[1];
-        buf4[0][3] += sample_r[1];
-        buf4[1][0] += sample_l[2];
-        buf4[1][1] += sample_r[2];
-        buf4[1][2] += sample_l[3];
-        buf4[1][3] += sample_r[3];
+      v4sf sample_l = sample;
+      if (ringmod) {
+        // Avoid zero input to powpnz here by adding FLT_MIN
+        sample_l = sample * powpnzsin4f(f_rm, srate_at(in->ringmod_rate, i)+FLT_MIN);
+        if (stereo)
+          out_r[i] +=
+            sample * powpnzsin4f(f_rm+F2PI*srate_at(in->stereo, i), srate_at(in->ringmod_rate, i)+FLT_MIN);
       }
+
+      out_l[i] += sample_l;
+    }
+
+    phase = fmodf(phase + inc_from * len + inc_slope * 0.5f * len * (len - 1), F2PI);
+    inc_from = inc_to;
+    amp_from = amp_to;
+  }
+
+  overtone->accum_rads = phase;
+  overtone->accum_rm_rads = fmodf(f_rm[in->idx_last], F2PI);
+  overtone->ramp_inc = inc_from;
+  overtone->ramp_amp = amp_from;
+  overtone->ramp_primed = TRUE;
+}
+
+static inline __attribute__((always_inline))
+void fill_overtone_inline(const KernelInput* const in, StateOvertone* const overtone, const gint j,
+                          v4sf* const out_l, v4sf* const out_r, const guint features) {
+  const gboolean boost = (features & KERNEL_BOOST) != 0;
+  const gboolean ringmod = (features & KERNEL_RINGMOD) != 0;
+  const gboolean stereo = (features & KERNEL_STEREO) != 0;
+  const gboolean amp_const = (features & KERNEL_AMP_CONST) != 0;
+
+  if (features & KERNEL_RAMP) {
+    fill_overtone_ramp_inline(in, overtone, j, out_l, out_r, features);
+    return;
+  }
+  
+  v4sf f = overtone->accum_rads * V4SF_UNIT;
+  v4sf f_rm = overtone->accum_rm_rads * V4SF_UNIT;
+
+  v4sf hscale_freq_const = V4SF_ZERO;
+  v4sf hscale_amp_const = V4SF_ZERO;
+  if (amp_const) {
+    hscale_freq_const =
+      srate_at(in->ampfreq_scale_idx_mul, 0) * (gfloat)j + srate_at(in->ampfreq_scale_offset, 0);
+    hscale_amp_const =
+      pow4f_method(srate_at(in->amp_pow_base, 0), (gfloat)j * srate_at(in->amp_exp_idx_mul, 0))
+      * pow4f_method(hscale_freq_const, srate_at(in->ampfreq_scale_exp, 0));
+  }
+  
+  for (guint i = 0; i < in->n4frames; ++i) {
+    const v4sf hscale_freq =
+      amp_const ?
+      hscale_freq_const :
+      srate_at(in->ampfreq_scale_idx_mul, i) * (gfloat)j + srate_at(in->ampfreq_scale_offset, i);
+    
+    const v4sf freq_overtone = srate_at(in->freq_note_bent, i) * hscale_freq;
+
+    // Update accumulators now so that they will still be updated even if a muted sample is skipped.
+    // The ringmod accumulator is kept running when ringmod is off so that its phase is intact when it's re-enabled.
+    const v4sf time_to_rads = F2PI * freq_overtone;
+    const v4sf inc = time_to_rads * in->secs_per_sample;
+    const v4sf inc_rm = inc * srate_at(in->ringmod_depth, i);
+
+    f = horizontal_accumulate(inc) + f[3];
+    f_rm = horizontal_accumulate(inc_rm) + f_rm[3];
+
+    // Limit the number of overtones to reduce aliasing.
+    const v4si mute_sample = (freq_overtone <= 0) | (freq_overtone > srate_at(in->freq_max, i));
+
+    // broad check to save CPU
+    if (v4si_eq(mute_sample, V4SI_TRUE))
+      continue;
+    
+    const v4sf amp_mute_sample = bitselect4f(mute_sample, V4SF_ZERO, V4SF_UNIT);
+
+    v4sf amp;
+    if (amp_const) {
+      amp = hscale_amp_const;
+    } else {
+      amp =
+        pow4f_method(srate_at(in->amp_pow_base, i), (gfloat)j * srate_at(in->amp_exp_idx_mul, i))
+        * pow4f_method(hscale_freq, srate_at(in->ampfreq_scale_exp, i));
+    }
+
+    if (boost) {
+      amp += srate_at(in->amp_boost_db, i) * powpnz4f(window_sharp_cosine4(
+                                                        freq_overtone,
+                                                        srate_at(in->amp_boost_center, i),
+                                                        22050,
+                                                        srate_at(in->amp_boost_sharpness, i)),
+                                                      srate_at(in->amp_boost_exp, i)+FLT_MIN);
+    }
+
+    const v4sf sample = amp * amp_mute_sample * sin4f(f);
       
-      buf4 += 2;
+    v4sf sample_l = sample;
+    if (ringmod) {
+      // Avoid zero input to powpnz here by adding FLT_MIN
+      sample_l = sample * powpnzsin4f(f_rm, srate_at(in->ringmod_rate, i)+FLT_MIN);
+      if (stereo)
+        out_r[i] +=
+          sample * powpnzsin4f(f_rm+F2PI*srate_at(in->stereo, i), srate_at(in->ringmod_rate, i)+FLT_MIN);
     }
 
-    overtone->accum_rads = fmodf(f[3], F2PI);
-    overtone->accum_rm_rads = fmodf(f_rm[3], F2PI);
+    out_l[i] += sample_l;
+  }
+
+  overtone->accum_rads = fmodf(f[in->idx_last], F2PI);
+  overtone->accum_rm_rads = fmodf(f_rm[in->idx_last], F2PI);
+}
+
+#define DEFINE_OVERTONE_KERNEL(features)                                \
+  static void fill_overtone_##features(const KernelInput* in, StateOvertone* overtone, gint j, \
+                                       v4sf* out_l, v4sf* out_r) {  \
+    fill_overtone_inline(in, overtone, j, out_l, out_r, features);      \
+  }
+
+DEFINE_OVERTONE_KERNEL(0)
+DEFINE_OVERTONE_KERNEL(1)
+DEFINE_OVERTONE_KERNEL(2)
+DEFINE_OVERTONE_KERNEL(3)
+DEFINE_OVERTONE_KERNEL(4)
+DEFINE_OVERTONE_KERNEL(5)
+DEFINE_OVERTONE_KERNEL(6)
+DEFINE_OVERTONE_KERNEL(7)
+DEFINE_OVERTONE_KERNEL(8)
+DEFINE_OVERTONE_KERNEL(9)
+DEFINE_OVERTONE_KERNEL(10)
+DEFINE_OVERTONE_KERNEL(11)
+DEFINE_OVERTONE_KERNEL(12)
+DEFINE_OVERTONE_KERNEL(13)
+DEFINE_OVERTONE_KERNEL(14)
+DEFINE_OVERTONE_KERNEL(15)
+DEFINE_OVERTONE_KERNEL(16)
+DEFINE_OVERTONE_KERNEL(17)
+DEFINE_OVERTONE_KERNEL(18)
+DEFINE_OVERTONE_KERNEL(19)
+DEFINE_OVERTONE_KERNEL(20)
+DEFINE_OVERTONE_KERNEL(21)
+DEFINE_OVERTONE_KERNEL(22)
+DEFINE_OVERTONE_KERNEL(23)
+DEFINE_OVERTONE_KERNEL(24)
+DEFINE_OVERTONE_KERNEL(25)
+DEFINE_OVERTONE_KERNEL(26)
+DEFINE_OVERTONE_KERNEL(27)
+DEFINE_OVERTONE_KERNEL(28)
+DEFINE_OVERTONE_KERNEL(29)
+DEFINE_OVERTONE_KERNEL(30)
+DEFINE_OVERTONE_KERNEL(31)
+
+// Indexed by a combination of KERNEL_* flags.
+static const OvertoneKernel overtone_kernels[N_KERNELS] = {
+  fill_overtone_0, fill_overtone_1, fill_overtone_2, fill_overtone_3,
+  fill_overtone_4, fill_overtone_5, fill_overtone_6, fill_overtone_7,
+  fill_overtone_8, fill_overtone_9, fill_overtone_10, fill_overtone_11,
+  fill_overtone_12, fill_overtone_13, fill_overtone_14, fill_overtone_15,
+  fill_overtone_16, fill_overtone_17, fill_overtone_18, fill_overtone_19,
+  fill_overtone_20, fill_overtone_21, fill_overtone_22, fill_overtone_23,
+  fill_overtone_24, fill_overtone_25, fill_overtone_26, fill_overtone_27,
+  fill_overtone_28, fill_overtone_29, fill_overtone_30, fill_overtone_31
+};
+
+static guint overtone_kernel_features(const GstBtAdditive* const self, const StateVirtualVoice* const vvoice) {
+  guint features = 0;
+
+  if (!srate_prop_is_zero(vvoice, PROP_AMP_BOOST_DB))
+    features |= KERNEL_BOOST;
+  
+  if (!srate_prop_is_zero(vvoice, PROP_RINGMOD_RATE)) {
+    features |= KERNEL_RINGMOD;
+    
+    // There's only one channel to render to with mono output, which is taken to be the left.
+    if (self->output_layout != OUTPUT_MONO && !srate_prop_is_zero(vvoice, PROP_STEREO))
+      features |= KERNEL_STEREO;
   }
+
+  if (srate_prop_is_const(vvoice, PROP_AMPFREQ_SCALE_IDX_MUL) &&
+      srate_prop_is_const(vvoice, PROP_AMPFREQ_SCALE_OFFSET) &&
+      srate_prop_is_const(vvoice, PROP_AMPFREQ_SCALE_EXP) &&
+      srate_prop_is_const(vvoice, PROP_AMP_POW_BASE) &&
+      srate_prop_is_const(vvoice, PROP_AMP_EXP_IDX_MUL))
+    features |= KERNEL_AMP_CONST;
+
+  if (self->params->partial_ramp_frames != 0)
+    features |= KERNEL_RAMP;
+
+  return features;
+}
+
+// Renders one tile of a virtual voice into its planar tile buffer. Volume is applied later, by mix_tile.
+static void fill_tile(GstBtAdditive* const self, StateVirtualVoice* const vvoice,
+                      const GstClockTime timestamp, const GstClockTime interval, const guint nframes) {
+  const guint n4frames = n4_ceil(nframes);
   
-  const v4sf* const vol_srate = (v4sf*)srate_prop_buf_get(self, vvoice, PROP_VOL);
+  srate_props_fill(self, vvoice, timestamp, interval, nframes);
 
-  v4sf* buf4 = buffer;
-  for (guint i = 0; i < n4frames; ++i) {
-    *(buf4++) *= vol_srate[i];
-    *(buf4++) *= vol_srate[i];
+  vvoice->tile_silent = is_machine_silent(self, vvoice);
+  if (vvoice->tile_silent) {
+    overtones_ramp_unprime(vvoice);
+    return;
   }
+
+  const guint features = overtone_kernel_features(self, vvoice);
+  vvoice->tile_stereo = (features & KERNEL_STEREO) != 0;
+  
+  v4sf* const out_l = (v4sf*)vvoice->buf_tile;
+  v4sf* const out_r = (v4sf*)(vvoice->buf_tile + TILE_FRAMES);
+  memset(out_l, 0, sizeof(v4sf) * n4frames);
+  if (vvoice->tile_stereo)
+    memset(out_r, 0, sizeof(v4sf) * n4frames);
+
+  const gfloat freq_note = (gfloat)gstbt_tone_conversion_translate_from_number(self->tones, vvoice->note);
+
+  // The bend is already a frequency ratio. The note can change between control points, so it's applied per tile.
+  const SrateBufDesc desc_note = {.kind = SRATE_BUF_CONST, .value = freq_note, .nonzero = freq_note != 0};
+  srate_buf_mul(&vvoice->srate_descs[PROP_BEND-1], srate_prop_buf_get(self, vvoice, PROP_BEND), &desc_note, NULL,
+                nframes);
+
+  const KernelInput in = {
+    .freq_note_bent = kernel_srate(self, vvoice, PROP_BEND),
+    .freq_max = kernel_srate(self, vvoice, PROP_FREQ_MAX),
+    .ampfreq_scale_idx_mul = kernel_srate(self, vvoice, PROP_AMPFREQ_SCALE_IDX_MUL),
+    .ampfreq_scale_offset = kernel_srate(self, vvoice, PROP_AMPFREQ_SCALE_OFFSET),
+    .ampfreq_scale_exp = kernel_srate(self, vvoice, PROP_AMPFREQ_SCALE_EXP),
+    .amp_boost_center = kernel_srate(self, vvoice, PROP_AMP_BOOST_CENTER),
+    .amp_boost_sharpness = kernel_srate(self, vvoice, PROP_AMP_BOOST_SHARPNESS),
+    .amp_boost_exp = kernel_srate(self, vvoice, PROP_AMP_BOOST_EXP),
+    .amp_boost_db = kernel_srate(self, vvoice, PROP_AMP_BOOST_DB),
+    .amp_pow_base = kernel_srate(self, vvoice, PROP_AMP_POW_BASE),
+    .amp_exp_idx_mul = kernel_srate(self, vvoice, PROP_AMP_EXP_IDX_MUL),
+    .ringmod_rate = kernel_srate(self, vvoice, PROP_RINGMOD_RATE),
+    .ringmod_depth = kernel_srate(self, vvoice, PROP_RINGMOD_DEPTH),
+    .stereo = kernel_srate(self, vvoice, PROP_STEREO),
+    .secs_per_sample = 1.0f / self->parent.info.rate,
+    .nframes = nframes,
+    .n4frames = n4frames,
+    .ramp_frames = self->params->partial_ramp_frames,
+    .idx_last = (nframes - 1) % 4
+  };
+
+  const OvertoneKernel kernel = overtone_kernels[features];
+  
+  const guint overtones = self->params->overtones;
+  for (int j = self->params->sum_start_idx, idx_o = 0; idx_o < overtones; ++j, ++idx_o) {
+    g_assert(idx_o < MAX_OVERTONES);
+    kernel(&in, &vvoice->states_overtone[idx_o], j, out_l, out_r);
+  }
+
+  // Overtones that have dropped out of the range rendered mustn't ramp from stale values if they come back.
+  for (guint i = overtones; i < vvoice->overtones_ramp_primed; ++i) {
+    vvoice->states_overtone[i].ramp_primed = FALSE;
+  }
+  vvoice->overtones_ramp_primed = overtones;
 }
 
-static gboolean process(GstBtAudioSynth* synth, GstBuffer* gstbuf, GstMapInfo* info) {
-  struct timespec clock_start;
-  clock_gettime(CLOCK_MONOTONIC_RAW, &clock_start);
+static inline __attribute__((always_inline)) void store4f(gfloat* const dst, const v4sf v, const gboolean aligned) {
+  if (aligned)
+    *(v4sf*)dst = v;
+  else
+    store4f_unaligned(dst, v);
+}
 
-  GstBtAdditive* const self = GSTBT_ADDITIVE(synth);
+// Uniform noise in [0, 1) from a per-lane linear congruential generator. Plenty good enough for dither.
+static inline v4sf dither_rand4f(v4ui* const state) {
+  *state = *state * 1664525u + 1013904223u;
+  return __builtin_convertvector(*state >> 8, v4sf) * (1.0f / (1 << 24));
+}
+
+// Converts "n" (1 to 4) samples to the output format and writes them to "out" starting at sample index "idx".
+//
+// Integer output is rounded rather than truncated. S16 can optionally be TPDF dithered at +/-1 LSB, which removes
+// the correlation of the quantization error with the signal. S32 is never dithered as its LSB is well below the
+// precision of the float samples.
+static inline __attribute__((always_inline))
+void store_samples(GstBtAdditive* const self, void* const out, const guint idx, const v4sf v, const guint n,
+                   const OutputFormat format, const gboolean aligned) {
+  switch (format) {
+  case OUTPUT_F32:
+    if (n == 4) {
+      store4f((gfloat*)out + idx, v, aligned);
+    } else {
+      gfloat tail[4];
+      store4f_unaligned(tail, v);
+      memcpy((gfloat*)out + idx, tail, sizeof(gfloat) * n);
+    }
+    break;
+  case OUTPUT_S16: {
+    v4sf x = v * 32768.0f;
+    if (self->params->dither)
+      x += dither_rand4f(&self->dither_state) + dither_rand4f(&self->dither_state) - 1.0f;
+    const v4ss samples = __builtin_convertvector(round4i(clamp4f(x, V4SF_ZERO - 32768.0f, V4SF_ZERO + 32767.0f)), v4ss);
+    memcpy((gint16*)out + idx, &samples, sizeof(gint16) * n);
+    break;
+  }
+  case OUTPUT_S32: {
+    // 2147483520 is the largest float below 2^31.
+    const v4si samples =
+      round4i(clamp4f(v * 2147483648.0f, V4SF_ZERO - 2147483648.0f, V4SF_ZERO + 2147483520.0f));
+    memcpy((gint32*)out + idx, &samples, sizeof(gint32) * n);
+    break;
+  }
+  default:
+    g_assert_not_reached();
+  }
+}
 
-  const guint requested_frames = self->parent.generate_samples_per_buffer;
-  const guint required_bufsamps = (requested_frames+3)*4/16*4*2;
-  g_assert(required_bufsamps % 4 == 0);
+// The single pass over the output for a tile: applies each virtual voice's volume, sums the virtual voices and
+// writes the result into "out" in the given layout and format, starting at sample index "idx". Exactly "nframes"
+// frames are written, so "out" can be the GstBuffer itself. For planar output, "plane_stride" is the distance in
+// samples from the left plane to the right.
+//
+// Non-temporal stores aren't used: the buffer is read by the next element straight away and should stay cached.
+static inline __attribute__((always_inline))
+void mix_tile_inline(GstBtAdditive* const self, void* const out, const guint idx, const guint plane_stride,
+                     const guint nframes, const OutputLayout layout, const OutputFormat format,
+                     const gboolean aligned) {
+  KernelSrate vols[MAX_VIRTUAL_VOICES];
+  const v4sf* ls[MAX_VIRTUAL_VOICES];
+  const v4sf* rs[MAX_VIRTUAL_VOICES];
+  guint n_active = 0;
   
-  if (self->buf_samples < required_bufsamps) {
-    GST_INFO("Reallocating internal buffers (%d frames, from %d to %d 4-aligned)",
-             self->parent.generate_samples_per_buffer, self->buf_samples, required_bufsamps);
+  for (guint i = 0; i < self->params->n_virtual_voices; ++i) {
+    const StateVirtualVoice* const vvoice = &self->virtual_voices[i];
+    if (!vvoice->tile_silent) {
+      vols[n_active] = kernel_srate(self, vvoice, PROP_VOL);
+      ls[n_active] = (const v4sf*)vvoice->buf_tile;
+      rs[n_active] = vvoice->tile_stereo ? (const v4sf*)(vvoice->buf_tile + TILE_FRAMES) : ls[n_active];
+      ++n_active;
+    }
+  }
+  
+  for (guint i = 0; i < n4_ceil(nframes); ++i) {
+    // Frames in this group, less than 4 only for the ragged tail of the buffer.
+    const guint n = MIN(4, nframes - i*4);
     
-    self->buf_samples = required_bufsamps;
+    v4sf l = V4SF_ZERO;
+    for (guint j = 0; j < n_active; ++j) {
+      l += srate_at(vols[j], i) * ls[j][i];
+    }
+
+    if (layout == OUTPUT_MONO) {
+      store_samples(self, out, idx + i*4, l, n, format, aligned);
+      continue;
+    }
     
-    self->buf = g_realloc(self->buf, sizeof(typeof(*(self->buf))) * self->buf_samples);
+    v4sf r = V4SF_ZERO;
+    for (guint j = 0; j < n_active; ++j) {
+      r += srate_at(vols[j], i) * rs[j][i];
+    }
 
-    for (guint i = 0; i < MAX_VIRTUAL_VOICES; ++i) {
-      self->virtual_voices[i].buf_srate_props =
-        g_realloc(
-          self->virtual_voices[i].buf_srate_props,
-          sizeof(typeof(*(self->virtual_voices[i].buf_srate_props))) * (self->buf_samples/2) * (N_PROPERTIES_SRATE-1));
+    if (layout == OUTPUT_PLANAR) {
+      store_samples(self, out, idx + i*4, l, n, format, aligned);
+      store_samples(self, out, idx + plane_stride + i*4, r, n, format, aligned);
+      continue;
+    }
+    
+    const v4sf lr01 = __builtin_shuffle(l, r, (v4si){0, 4, 1, 5});
+    const v4sf lr23 = __builtin_shuffle(l, r, (v4si){2, 6, 3, 7});
+    
+    store_samples(self, out, idx + i*8, lr01, MIN(4, n*2), format, aligned);
+    if (n > 2)
+      store_samples(self, out, idx + i*8 + 4, lr23, n*2 - 4, format, aligned);
+  }
+}
+
+typedef void (*MixTile)(GstBtAdditive* self, void* out, guint idx, guint plane_stride, guint nframes);
+
+#define MIX_TILE(layout, format, alignment) mix_tile_##layout##_##format##_##alignment
+
+#define DEFINE_MIX_TILE(layout, format, alignment, aligned)                                             \
+  static void MIX_TILE(layout, format, alignment)(GstBtAdditive* const self, void* const out, const guint idx, \
+                                                  const guint plane_stride, const guint nframes) {      \
+    mix_tile_inline(self, out, idx, plane_stride, nframes, layout, format, aligned);                   \
+  }
+
+#define DEFINE_MIX_TILES(layout)                              \
+  DEFINE_MIX_TILE(layout, OUTPUT_F32, aligned, TRUE)          \
+  DEFINE_MIX_TILE(layout, OUTPUT_F32, unaligned, FALSE)       \
+  DEFINE_MIX_TILE(layout, OUTPUT_S16, unaligned, FALSE)       \
+  DEFINE_MIX_TILE(layout, OUTPUT_S32, unaligned, FALSE)
+
+DEFINE_MIX_TILES(OUTPUT_INTERLEAVED)
+DEFINE_MIX_TILES(OUTPUT_PLANAR)
+DEFINE_MIX_TILES(OUTPUT_MONO)
+
+// Indexed by [OutputFormat][aligned]. Integer formats are written through memcpy, so alignment doesn't matter.
+#define MIX_TILES(layout) {                                                                                 \
+    [OUTPUT_F32] = { MIX_TILE(layout, OUTPUT_F32, unaligned), MIX_TILE(layout, OUTPUT_F32, aligned) },      \
+    [OUTPUT_S16] = { MIX_TILE(layout, OUTPUT_S16, unaligned), MIX_TILE(layout, OUTPUT_S16, unaligned) },    \
+    [OUTPUT_S32] = { MIX_TILE(layout, OUTPUT_S32, unaligned), MIX_TILE(layout, OUTPUT_S32, unaligned) }     \
+  }
+
+static const MixTile mix_tiles[N_OUTPUT_LAYOUTS][N_OUTPUT_FORMATS][2] = {
+  [OUTPUT_INTERLEAVED] = MIX_TILES(OUTPUT_INTERLEAVED),
+  [OUTPUT_PLANAR] = MIX_TILES(OUTPUT_PLANAR),
+  [OUTPUT_MONO] = MIX_TILES(OUTPUT_MONO)
+};
+
+#undef MIX_TILES
+#undef DEFINE_MIX_TILES
+#undef DEFINE_MIX_TILE
+#undef MIX_TILE
+
+static OutputLayout output_layout_get(const GstAudioInfo* const info) {
+  if (GST_AUDIO_INFO_CHANNELS(info) == 1)
+    return OUTPUT_MONO;
+  else if (GST_AUDIO_INFO_LAYOUT(info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+    return OUTPUT_PLANAR;
+  else
+    return OUTPUT_INTERLEAVED;
+}
+
+static OutputFormat output_format_get(const GstAudioInfo* const info) {
+  switch (GST_AUDIO_INFO_FORMAT(info)) {
+  case GST_AUDIO_FORMAT_S16:
+    return OUTPUT_S16;
+  case GST_AUDIO_FORMAT_S32:
+    return OUTPUT_S32;
+  default:
+    g_assert(GST_AUDIO_INFO_FORMAT(info) == GST_AUDIO_FORMAT_F32);
+    return OUTPUT_F32;
+  }
+}
+
+// Renders a span of frames between notes for render_frames, which has the same arguments.
+static void render_span(GstBtAdditive* const self, void* const out, const guint plane_stride,
+                        const guint first_frame, const guint nframes,
+                        const GstClockTime pts, const GstClockTime running_time) {
+  // The virtual voices read their parameters directly from these voices.
+  for (guint i = 0; i < self->params->n_voices; ++i)
+    gstbt_additivev_process(self->voices[i], pts);
+
+  srate_props_base_read(self);
+  srate_bindings_begin(self, pts, running_time);
+
+  // The frames are rendered in tiles of TILE_FRAMES, with all overtones of all virtual voices rendered for a tile
+  // before moving to the next. The tile's s-rate property buffers then stay in the L1 cache no matter how large the
+  // buffer is. Each tile is mixed directly into the output.
+  const GstClockTime interval = GST_SECOND / self->parent.info.rate;
+  const guint channels = GST_AUDIO_INFO_CHANNELS(&self->parent.info);
+  
+  // Planar output starts each tile at the same offset in both planes.
+  const guint samples_per_frame = self->output_layout == OUTPUT_PLANAR ? 1 : channels;
+
+  // Buffers from the element's pool are always aligned, but downstream, the fallback path in _alloc or an odd
+  // internal block size might give others. Tiles are a multiple of 4 frames in size, so every tile is aligned if the
+  // first is. The right plane of planar output is only aligned if the left plane is a whole number of vectors long.
+  const gboolean aligned =
+    (guintptr)((gfloat*)out + first_frame * samples_per_frame) % sizeof(v4sf) == 0 &&
+    (self->output_layout != OUTPUT_PLANAR || plane_stride % 4 == 0);
+  const MixTile mix = mix_tiles[self->output_layout][self->output_format][aligned];
+  
+  for (guint offset = 0; offset < nframes; offset += TILE_FRAMES) {
+    const guint tile_frames = MIN(TILE_FRAMES, nframes - offset);
+    const GstClockTime timestamp = running_time + offset * interval;
       
-      for (int j = 0; j < MAX_VOICES; j++) {
-        gstbt_additivev_on_buf_size_change(self->virtual_voices[i].voices[j], self->buf_samples/2);
-      }
+    for (guint i = 0; i < self->params->n_virtual_voices; ++i) {
+      fill_tile(self, &self->virtual_voices[i], timestamp, interval, tile_frames);
     }
+
+    mix(self, out, (first_frame + offset) * samples_per_frame, plane_stride, tile_frames);
   }
+}
 
-  gfloat* outbuf = (gfloat*)(info->data);
-  guint to_copy = requested_frames*2;
-  const gfloat* internal_buf = self->buf + self->buf_samples - self->nsamples_available;
+// The first frame, counted from one at running time "running_time", at or after running time "time". "time" must be
+// after "running_time".
+static guint64 event_frame(const GstClockTime time, const GstClockTime running_time, const GstClockTime interval) {
+  return (time - running_time + interval - 1) / interval;
+}
 
-  const guint n_residual_copy = MIN(self->nsamples_available, to_copy);
-  memcpy(outbuf, internal_buf, sizeof(gfloat) * n_residual_copy);
-  internal_buf += n_residual_copy;
-  outbuf += n_residual_copy;
-  self->nsamples_available -= n_residual_copy;
-  to_copy -= n_residual_copy;
+// Renders "nframes" frames into "out" starting at frame "first_frame". "plane_stride" is the number of frames in each
+// plane of planar output. "pts" is used to sync the voices' controlled properties and "running_time" to evaluate
+// the s-rate properties, both for the first frame.
+//
+// Rendering is split at the frame of each note due in the block, so that notes start on time whatever the block size.
+static void render_frames(GstBtAdditive* const self, void* const out, const guint plane_stride,
+                          const guint first_frame, const guint nframes,
+                          const GstClockTime pts, const GstClockTime running_time) {
+  events_take(self);
+  srate_bindings_update(self);
+  
+  const GstClockTime interval = GST_SECOND / self->parent.info.rate;
+  guint done = 0;
+  guint idx_event = 0;
 
-  if (self->nsamples_available == 0 && to_copy != 0) {
-    for (int i = 0; i < self->n_voices; ++i) {
-      gstbt_additivev_process(self->voices[i], gstbuf);
-      for (guint j = 0; j < self->n_virtual_voices; ++j) {
-        // tbd: this doesn't have to happen. The virtual voice LFOs and ADSRs could read directly from the parameters.
-        gstbt_additivev_copy(self->voices[i], self->virtual_voices[j].voices[i]);
-      }
+  while (done < nframes) {
+    const GstClockTime span_running_time = running_time + done * interval;
+    
+    for (; idx_event < self->n_events_pending && self->events_pending[idx_event].time <= span_running_time;
+         ++idx_event) {
+      event_apply(self, &self->events_pending[idx_event], span_running_time);
+    }
+
+    // Render up to the first frame at or after the next note. That frame is after "done", as the note is after it.
+    guint end = nframes;
+    if (idx_event < self->n_events_pending) {
+      const guint64 offset = event_frame(self->events_pending[idx_event].time, running_time, interval);
+      end = (guint)MIN(offset, (guint64)nframes);
     }
 
-    self->nsamples_available = self->buf_samples;
-    memset(self->buf, 0, self->nsamples_available*sizeof(typeof(*self->buf)));
+    render_span(self, out, plane_stride, first_frame + done, end - done,
+                GST_CLOCK_TIME_IS_VALID(pts) ? pts + done * interval : pts, span_running_time);
+    done = end;
+  }
+
+  // Notes for later blocks stay pending.
+  self->n_events_pending -= idx_event;
+  memmove(self->events_pending, self->events_pending + idx_event, sizeof(Event) * self->n_events_pending);
+}
+
+// Copies "nframes" frames from the staging block to "out" at frame "first_frame". "plane_stride" is as for
+// render_frames.
+static void staging_consume(GstBtAdditive* const self, guint8* const out, const guint plane_stride,
+                            const guint first_frame, const guint nframes) {
+  g_assert(self->staging_offset + nframes <= self->staging_frames);
   
-    v4sf* const buf4 = (v4sf*)self->buf;
-    v4sf* const buf4_vvoice = g_alloca(self->buf_samples/4 * sizeof(v4sf));
-    for (guint i = 0; i < self->n_virtual_voices; ++i) {
-      fill_buffer_internal(self, &self->virtual_voices[i], gstbuf, buf4_vvoice, self->buf_samples/2);
-      for (guint j = 0; j < self->buf_samples/4; ++j) {
-        buf4[j] += buf4_vvoice[j];
-      }
+  if (self->output_layout == OUTPUT_PLANAR) {
+    const guint bps = GST_AUDIO_INFO_WIDTH(&self->parent.info) / 8;
+    for (guint c = 0; c < GST_AUDIO_INFO_CHANNELS(&self->parent.info); ++c) {
+      memcpy(out + (c * plane_stride + first_frame) * bps,
+             self->staging + (c * self->staging_frames + self->staging_offset) * bps,
+             nframes * bps);
     }
+  } else {
+    const guint bpf = GST_AUDIO_INFO_BPF(&self->parent.info);
+    memcpy(out + first_frame * bpf, self->staging + self->staging_offset * bpf, nframes * bpf);
+  }
+
+  self->staging_offset += nframes;
+}
 
-    internal_buf = self->buf;
+static gboolean process(GstBtAudioSynth* synth, GstBuffer* gstbuf, GstMapInfo* info) {
+  struct timespec clock_start;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &clock_start);
+
+  GstBtAdditive* const self = GSTBT_ADDITIVE(synth);
+  rt_check_enter(&self->rt_check);
+  __atomic_store_n(&self->streaming_thread, g_thread_self(), __ATOMIC_RELAXED);
+  
+  // Must be set before any tile is rendered, as the kernel selection depends on it.
+  const OutputLayout layout = output_layout_get(&self->parent.info);
+  const OutputFormat format = output_format_get(&self->parent.info);
+  if (layout != self->output_layout || format != self->output_format) {
+    // Staged frames are in the old format.
+    self->staging_offset = self->staging_frames;
+    self->output_layout = layout;
+    self->output_format = format;
   }
+
+  const GstClockTime interval = GST_SECOND / self->parent.info.rate;
+  const guint nframes = self->parent.generate_samples_per_buffer;
+  const GstClockTime pts = GST_BUFFER_PTS(gstbuf);
+  g_assert(info->size >= nframes * GST_AUDIO_INFO_BPF(&self->parent.info));
+
+  if (self->output_layout == OUTPUT_PLANAR) {
+    // Planar buffers must describe their planes. Passing NULL offsets gives tightly packed planes of "nframes". The
+    // meta is marked as pooled so that it stays with the buffer when it goes back to the pool, and is only made again
+    // if it no longer fits.
+    GstAudioMeta* meta = gst_buffer_get_audio_meta(gstbuf);
+    if (meta && (meta->samples != nframes || !gst_audio_info_is_equal(&meta->info, &self->parent.info))) {
+      gst_buffer_remove_meta(gstbuf, (GstMeta*)meta);
+      meta = NULL;
+    }
+    
+    if (!meta) {
+      meta = gst_buffer_add_audio_meta(gstbuf, &self->parent.info, nframes, NULL);
+      GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+    }
+  }
+
+  // The parameters are taken at the start of each block, after any sync for it.
+  params_acquire(self);
   
-  g_assert(to_copy <= self->nsamples_available);
-  memcpy(outbuf, internal_buf, sizeof(gfloat) * to_copy);
-  self->nsamples_available -= to_copy;
+  if (self->params->block_frames == 0) {
+    render_frames(self, info->data, nframes, 0, nframes, pts, self->parent.running_time);
+  } else {
+    // Rendering happens in blocks of block_frames. Whole blocks are rendered straight into the buffer, and the block
+    // that straddles the end of the buffer is rendered into the staging block so its remainder can start the next
+    // buffer.
+    guint done = 0;
+
+    if (self->staging_offset < self->staging_frames) {
+      // Anything but the buffer that directly follows, i.e. after a seek, makes the staged frames useless.
+      if (GST_CLOCK_TIME_IS_VALID(pts) && GST_CLOCK_TIME_IS_VALID(self->staging_pts) &&
+          ABS(GST_CLOCK_DIFF(pts, self->staging_pts)) < interval) {
+        done = MIN(nframes, self->staging_frames - self->staging_offset);
+        staging_consume(self, info->data, nframes, 0, done);
+      } else {
+        GST_DEBUG_OBJECT(self, "Discarding %u staged frames", self->staging_frames - self->staging_offset);
+        self->staging_offset = self->staging_frames;
+      }
+    }
+
+    while (done < nframes) {
+      const GstClockTime block_pts = GST_CLOCK_TIME_IS_VALID(pts) ? pts + done * interval : pts;
+      const GstClockTime block_running_time = self->parent.running_time + done * interval;
+
+      // GstBtAudioSynth only syncs the element's own properties at the start of the buffer, so that block is left
+      // alone. Syncing it again would play any note set there twice. Without a PTS there's nothing to sync at.
+      if (block_pts != pts) {
+        __atomic_store_n(&self->sync_running_time, block_running_time, __ATOMIC_RELAXED);
+        gst_object_sync_values((GstObject*)self, block_pts);
+        __atomic_store_n(&self->sync_running_time, GST_CLOCK_TIME_NONE, __ATOMIC_RELAXED);
+        params_acquire(self);
+      }
+
+      // The block size can change between blocks. If it's now zero, the rest of the buffer is one block.
+      const guint block_frames = self->params->block_frames;
+      
+      if (block_frames == 0) {
+        render_frames(self, info->data, nframes, done, nframes - done, block_pts, block_running_time);
+        done = nframes;
+      } else if (nframes - done >= block_frames) {
+        render_frames(self, info->data, nframes, done, block_frames, block_pts, block_running_time);
+        done += block_frames;
+      } else {
+        self->staging_frames = block_frames;
+        self->staging_offset = 0;
+        render_frames(self, self->staging, self->staging_frames, 0, block_frames, block_pts, block_running_time);
+        staging_consume(self, info->data, nframes, done, nframes - done);
+        done = nframes;
+      }
+    }
+
+    self->staging_pts = GST_CLOCK_TIME_IS_VALID(pts) ?
+      pts + gst_util_uint64_scale_int(nframes, GST_SECOND, self->parent.info.rate) : GST_CLOCK_TIME_NONE;
+  }
+  rt_check_leave(&self->rt_check, (GstObject*)self);
 
   struct timespec clock_end;
   clock_gettime(CLOCK_MONOTONIC_RAW, &clock_end);
@@ -669,67 +2214,333 @@ static gboolean process(GstBtAudioSynth* synth, GstBuffer* gstbuf, GstMapInfo* i
   return TRUE;
 }
 
+// Frames rendered into the staging block are rendered ahead of time. Property changes that don't come through a
+// control source are only picked up at the next block, so the block length is reported as latency.
+static gboolean _query(GstBaseSrc* base, GstQuery* query) {
+  GstBtAdditive* const self = GSTBT_ADDITIVE(base);
+  
+  const gboolean result = GST_BASE_SRC_CLASS(gstbt_additive_parent_class)->query(base, query);
+
+  g_mutex_lock(&self->params_lock);
+  const guint block_frames = self->params_edit.block_frames;
+  g_mutex_unlock(&self->params_lock);
+
+  if (result && GST_QUERY_TYPE(query) == GST_QUERY_LATENCY && block_frames != 0 && self->parent.info.rate != 0) {
+    gboolean live;
+    GstClockTime min, max;
+    gst_query_parse_latency(query, &live, &min, &max);
+
+    const GstClockTime block_latency =
+      gst_util_uint64_scale_int(block_frames, GST_SECOND, self->parent.info.rate);
+    min += block_latency;
+    if (GST_CLOCK_TIME_IS_VALID(max))
+      max += block_latency;
+    
+    GST_DEBUG_OBJECT(self, "Latency: %" GST_TIME_FORMAT " - %" GST_TIME_FORMAT, GST_TIME_ARGS(min), GST_TIME_ARGS(max));
+    gst_query_set_latency(query, live, min, max);
+  }
+
+  return result;
+}
+
+// Applications can play a note at an exact running time, rather than at the start of the next buffer or block, by
+// sending the element an upstream custom event named "additive-note", with the fields "note" (GstBtNote) and
+// "running-time" (GstClockTime).
+static gboolean _event(GstBaseSrc* base, GstEvent* event) {
+  GstBtAdditive* const self = GSTBT_ADDITIVE(base);
+
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_UPSTREAM && gst_event_has_name(event, "additive-note")) {
+    const GstStructure* const structure = gst_event_get_structure(event);
+    gint note;
+    GstClockTime time;
+    
+    if (!gst_structure_get_enum(structure, "note", GSTBT_TYPE_NOTE, &note) ||
+        !gst_structure_get_clock_time(structure, "running-time", &time) ||
+        !GST_CLOCK_TIME_IS_VALID(time)) {
+      GST_WARNING_OBJECT(self, "Malformed note event: %" GST_PTR_FORMAT, structure);
+      return FALSE;
+    }
+
+    if (note != GSTBT_NOTE_NONE)
+      events_push(self, time, note);
+    return TRUE;
+  }
+  
+  return GST_BASE_SRC_CLASS(gstbt_additive_parent_class)->event(base, event);
+}
+
 static void _negotiate (GstBtAudioSynth* base, GstCaps* caps) {
   for (guint i = 0; i < gst_caps_get_size(caps); ++i) {
     GstStructure* const s = gst_caps_get_structure(caps, i);
     
     GST_LOG("caps structure %d: %" GST_PTR_FORMAT, i, (void*)s);
+
+    // The caps have already been intersected with what downstream accepts, so these only pick between the options
+    // it leaves open. Stereo is preferred as the ringmod stereo offset is lost in mono, interleaved as it's what most
+    // elements expect, and F32 as it needs no conversion and isn't quantized.
+    gst_structure_fixate_field_nearest_int(s, "channels", 2);
+    if (gst_structure_has_field(s, "layout"))
+      gst_structure_fixate_field_string(s, "layout", "interleaved");
+    if (gst_structure_has_field(s, "format"))
+      gst_structure_fixate_field_string(s, "format", GST_AUDIO_NE (F32));
   }
 }
 
-static void gstbt_additive_init(GstBtAdditive* const self) {
-  self->tones = gstbt_tone_conversion_new(GSTBT_TONE_CONVERSION_EQUAL_TEMPERAMENT);
+static void output_allocation_params(GstAllocationParams* const params) {
+  // GstAllocationParams alignment is given as a mask.
+  params->align = MAX(params->align, OUTPUT_ALIGN - 1);
+}
 
-  for (int j = 0; j < MAX_VIRTUAL_VOICES; j++) {
-    for (int i = 0; i < MAX_VOICES; i++) {
-      GstBtAdditiveV* voice = gstbt_additivev_new(&properties[1], N_PROPERTIES_SRATE, i);
+// Propose a pool of cache-line aligned output buffers sized for the current buffer length, so that the render kernels
+// can use aligned stores and no allocation happens per buffer in the steady state.
+static gboolean _decide_allocation(GstBaseSrc* base, GstQuery* query) {
+  GstBtAdditive* const self = GSTBT_ADDITIVE(base);
 
-      char name[7];
-      g_snprintf(name, sizeof(name), "voice%1d_%1d",j,i);
-        
-      gst_object_set_name((GstObject*)voice, name);
-      gst_object_set_parent((GstObject*)voice, (GstObject *)self);
+  GstAllocator* allocator = NULL;
+  GstAllocationParams params;
+  gst_allocation_params_init(&params);
+  
+  const gboolean update_params = gst_query_get_n_allocation_params(query) > 0;
+  if (update_params) {
+    gst_query_parse_nth_allocation_param(query, 0, &allocator, &params);
+  }
+  output_allocation_params(&params);
+
+  guint min = 0;
+  guint max = 0;
+  const gboolean update_pool = gst_query_get_n_allocation_pools(query) > 0;
+  if (update_pool) {
+    // Downstream's pool can't be relied on to honour the alignment, so only its buffer counts are kept.
+    GstBufferPool* downstream_pool = NULL;
+    guint downstream_size;
+    gst_query_parse_nth_allocation_pool(query, 0, &downstream_pool, &downstream_size, &min, &max);
+    if (downstream_pool)
+      gst_object_unref(downstream_pool);
+  }
+  min = MAX(min, OUTPUT_POOL_MIN_BUFFERS);
+  if (max != 0)
+    max = MAX(max, min);
 
-      self->virtual_voices[j].voices[i] = voice;
-    }
+  const guint size = self->parent.generate_samples_per_buffer * GST_AUDIO_INFO_BPF(&self->parent.info);
+  
+  GstBufferPool* const pool = gst_buffer_pool_new();
+  GstStructure* const config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_set_params(config, NULL, size, min, max);
+  gst_buffer_pool_config_set_allocator(config, allocator, &params);
+  
+  if (!gst_buffer_pool_set_config(pool, config)) {
+    GST_WARNING_OBJECT(self, "Couldn't configure output buffer pool");
+    gst_object_unref(pool);
+    if (allocator)
+      gst_object_unref(allocator);
+    return FALSE;
   }
 
-  for (int i = 0; i < MAX_VOICES; i++) {
-    GstBtAdditiveV* voice = gstbt_additivev_new(&properties[1], N_PROPERTIES_SRATE, i);
+  GST_INFO_OBJECT(self, "Output buffer pool: %u bytes, %u-%u buffers, align %u", size, min, max, OUTPUT_ALIGN);
+  self->pool_buffer_size = size;
+  
+  if (update_params)
+    gst_query_set_nth_allocation_param(query, 0, allocator, &params);
+  else
+    gst_query_add_allocation_param(query, allocator, &params);
+
+  if (update_pool)
+    gst_query_set_nth_allocation_pool(query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool(query, pool, size, min, max);
+
+  gst_object_unref(pool);
+  if (allocator)
+    gst_object_unref(allocator);
+  
+  return TRUE;
+}
 
-    char name[7];
-    g_snprintf(name, sizeof(name), "voice%1d",i);
-        
-    gst_object_set_name((GstObject*)voice, name);
-    gst_object_set_parent((GstObject*)voice, (GstObject *)self);
+static GstFlowReturn _alloc(GstBaseSrc* base, guint64 offset, guint size, GstBuffer** buffer) {
+  GstBtAdditive* const self = GSTBT_ADDITIVE(base);
 
-    self->voices[i] = voice;
+  if (size > self->pool_buffer_size) {
+    // The buffer length changes with tempo and ticks, and can outgrow the pool. This buffer is allocated directly
+    // and a larger pool is negotiated for the following ones.
+    GST_INFO_OBJECT(self, "Buffer of %u bytes exceeds pool size of %u, reconfiguring", size, self->pool_buffer_size);
+    gst_pad_mark_reconfigure(GST_BASE_SRC_PAD(base));
+    
+    GstAllocationParams params;
+    gst_allocation_params_init(&params);
+    output_allocation_params(&params);
+    *buffer = gst_buffer_new_allocate(NULL, size, &params);
+    return *buffer ? GST_FLOW_OK : GST_FLOW_ERROR;
   }
 
-  self->n_virtual_voices = 1;
+  const GstFlowReturn result = GST_BASE_SRC_CLASS(gstbt_additive_parent_class)->alloc(base, offset, size, buffer);
+
+  // Pool buffers can be larger than the buffer currently required.
+  if (result == GST_FLOW_OK && gst_buffer_get_size(*buffer) > size)
+    gst_buffer_resize(*buffer, 0, size);
+
+  return result;
+}
+
+static void gstbt_additive_init(GstBtAdditive* const self) {
+  g_mutex_init(&self->params_lock);
+  g_mutex_init(&self->resources_lock);
+  g_mutex_init(&self->events_lock);
+  self->sync_running_time = GST_CLOCK_TIME_NONE;
+  self->params_back = 0;
+  self->params_shared = 1;
+  self->params_front = 2;
+  self->params = &self->params_slots[self->params_front];
+  
+  self->tones = gstbt_tone_conversion_new(GSTBT_TONE_CONVERSION_EQUAL_TEMPERAMENT);
+  self->dither_state = (v4ui){1, 2, 3, 4};
+  self->staging_pts = GST_CLOCK_TIME_NONE;
+
+  self->params_edit.n_virtual_voices = 1;
+  g_mutex_lock(&self->resources_lock);
+  resources_update(self, 0, 1, 0);
+  g_mutex_unlock(&self->resources_lock);
 }
 
 static void _dispose (GObject* object) {
   GstBtAdditive* self = GSTBT_ADDITIVE(object);
   g_clear_object(&self->tones);
-  g_clear_pointer(&self->buf, g_free);
-  for (int i = 0; i < MAX_VIRTUAL_VOICES; i++) {
-    g_clear_pointer(&self->virtual_voices[i].buf_srate_props, g_free);
-  }
-  
+  srate_bindings_release(self);
   // It's necessary to unparent children so they will be unreffed and cleaned up. GstObject doesn't hold variable
   // links to its children, so it wouldn't know to unparent them and this would cause a memory leak.
-  for (int i = 0; i < MAX_VOICES; i++) {
-    gst_object_unparent((GstObject*)self->voices[i]);
+  // Each set of resources unparents the voices that the next one doesn't have, and the last one all of its voices.
+  while (self->resources_oldest) {
+    Resources* const res = self->resources_oldest;
+    self->resources_oldest = res->next;
+    resources_free(res);
   }
+  self->params_edit.resources = NULL;
+  self->resources = NULL;
   G_OBJECT_CLASS(gstbt_additive_parent_class)->dispose(object);
 }
 
+static void _finalize (GObject* object) {
+  GstBtAdditive* self = GSTBT_ADDITIVE(object);
+  g_mutex_clear(&self->params_lock);
+  g_mutex_clear(&self->resources_lock);
+  g_mutex_clear(&self->events_lock);
+  G_OBJECT_CLASS(gstbt_additive_parent_class)->finalize(object);
+}
+
+// Checks that the partial-ramp-frames kernel renders an overtone of constant frequency and amplitude as the kernel
+// that evaluates every sample does. Tiles of several lengths are rendered, so the phase carried between them is
+// checked too. Aborts on failure.
+static void kernel_ramp_test(void) {
+  const v4sf freq_note = 440 * V4SF_UNIT;
+  const v4sf freq_max = 22050 * V4SF_UNIT;
+  const v4sf one = V4SF_UNIT;
+  const v4sf zero = V4SF_ZERO;
+  const KernelSrate srate_one = {&one, 0};
+  const KernelSrate srate_zero = {&zero, 0};
+  
+  KernelInput in = {
+    .freq_note_bent = {&freq_note, 0},
+    .freq_max = {&freq_max, 0},
+    .ampfreq_scale_idx_mul = srate_one,
+    .ampfreq_scale_offset = srate_zero,
+    .ampfreq_scale_exp = srate_zero,
+    .amp_boost_center = srate_zero,
+    .amp_boost_sharpness = srate_zero,
+    .amp_boost_exp = srate_zero,
+    .amp_boost_db = srate_zero,
+    .amp_pow_base = srate_one,
+    .amp_exp_idx_mul = srate_zero,
+    .ringmod_rate = srate_zero,
+    .ringmod_depth = srate_zero,
+    .stereo = srate_zero,
+    .secs_per_sample = 1.0f / 44100,
+    .ramp_frames = 16
+  };
+
+  StateOvertone state = {0};
+  StateOvertone state_ramp = {0};
+  v4sf out[TILE_FRAMES/4];
+  v4sf out_ramp[TILE_FRAMES/4];
+  v4sf out_r[TILE_FRAMES/4];
+  const guint tiles[] = {TILE_FRAMES, 100, TILE_FRAMES, 37};
+  
+  for (guint t = 0; t < G_N_ELEMENTS(tiles); ++t) {
+    in.nframes = tiles[t];
+    in.n4frames = n4_ceil(tiles[t]);
+    in.idx_last = (tiles[t] - 1) % 4;
+
+    memset(out, 0, sizeof(out));
+    memset(out_ramp, 0, sizeof(out_ramp));
+    overtone_kernels[KERNEL_AMP_CONST](&in, &state, 3, out, out_r);
+    overtone_kernels[KERNEL_AMP_CONST | KERNEL_RAMP](&in, &state_ramp, 3, out_ramp, out_r);
+
+    for (guint i = 0; i < tiles[t]; ++i)
+      g_assert(fabsf(((gfloat*)out)[i] - ((gfloat*)out_ramp)[i]) < 1e-3f);
+  }
+}
+
+// Checks that the stepped rendering of envelope segments stays within the documented tolerance of evaluating each
+// frame exactly, across segment boundaries and for the largest exponent an envelope uses. Aborts on failure.
+static void srate_segs_test(void) {
+  const SrateSeg segs[] = {
+    {.end = 10, .kind = SRATE_SEG_CONST, .base = 0.25f},
+    // Curves that start from zero are evaluated exactly at first, and these that start part way are stepped.
+    {.end = 100, .kind = SRATE_SEG_POW, .base = 0.25f, .range = 0.75f, .alpha_inc = 1.0f/300, .exp = 10},
+    {.end = 430, .kind = SRATE_SEG_POW, .base = 0.25f, .range = 0.75f, .alpha = 0.3f, .alpha_inc = 1.0f/4000,
+     .exp = 10},
+    {.end = 530, .kind = SRATE_SEG_POW, .base = 1, .range = -0.6f, .alpha = 0.5f, .alpha_inc = 1.0f/3000, .exp = 0.3f},
+    {.end = 701, .kind = SRATE_SEG_LINEAR, .base = 0.4f, .range = -0.4f, .alpha = 0.1f, .alpha_inc = 1.0f/500},
+    {.end = 800, .kind = SRATE_SEG_CONST}
+  };
+  const guint n = 777;
+  v4sf buf[200];
+  SrateBufDesc desc;
+  
+  srate_segs_render(segs, G_N_ELEMENTS(segs), &desc, (gfloat*)buf, n);
+  g_assert(desc.kind == SRATE_BUF_ARRAY && desc.nonzero);
+
+  guint start = 0;
+  for (guint s = 0; s < G_N_ELEMENTS(segs); ++s) {
+    const SrateSeg* const seg = &segs[s];
+    const gfloat rel_tolerance =
+      seg->kind == SRATE_SEG_POW ? seg->exp / (8 * SRATE_SEG_POW_STEP_SPAN * SRATE_SEG_POW_STEP_SPAN) : 0;
+    
+    for (guint i = start; i < MIN(seg->end, n); ++i) {
+      const gfloat expected = srate_seg_at4(seg, (gfloat)(i - start) * V4SF_UNIT)[0];
+      g_assert(fabsf(((gfloat*)buf)[i] - expected) <= fabsf(expected - seg->base) * rel_tolerance + 1e-5f);
+    }
+    start = seg->end;
+  }
+}
+
+// Checks that a note near the boundary of two blocks starts on the same frame whichever block first sees it, and that
+// the frame is the first at or after the note's time. Aborts on failure.
+static void event_frame_test(void) {
+  const GstClockTime interval = GST_SECOND / 44100;
+  const guint block_frames = 64;
+  const GstClockTime block0 = 1000 * interval + 7;
+  const GstClockTime block1 = block0 + block_frames * interval;
+  
+  for (GstClockTime time = block1 - 3 * interval; time <= block1 + 3 * interval; time += interval / 3) {
+    const guint64 frame = event_frame(time, block0, interval);
+    g_assert(block0 + frame * interval >= time && block0 + (frame - 1) * interval < time);
+
+    if (frame < block_frames)
+      continue;
+    
+    // Rendering of the second block plays it at its start if it's due, and otherwise splits the block at its frame.
+    if (time <= block1)
+      g_assert(frame == block_frames);
+    else
+      g_assert(frame == block_frames + event_frame(time, block1, interval));
+  }
+}
+
 static void gstbt_additive_class_init(GstBtAdditiveClass * const klass) {
   GObjectClass* const gobject_class = (GObjectClass *) klass;
   gobject_class->set_property = _set_property;
   gobject_class->get_property = _get_property;
   gobject_class->dispose = _dispose;
+  gobject_class->finalize = _finalize;
 
   GstElementClass* const element_class = (GstElementClass *) klass;
   gst_element_class_set_static_metadata(
@@ -739,6 +2550,12 @@ static void gstbt_additive_class_init(GstBtAdditiveClass * const klass) {
     GST_MACHINE_DESC,
     PACKAGE_BUGREPORT);
 
+  GstBaseSrcClass* const base_src_class = (GstBaseSrcClass *) klass;
+  base_src_class->decide_allocation = _decide_allocation;
+  base_src_class->alloc = _alloc;
+  base_src_class->query = _query;
+  base_src_class->event = _event;
+
   GstBtAudioSynthClass *audio_synth_class = (GstBtAudioSynthClass *) klass;
   audio_synth_class->process = process;
   /*audio_synth_class->reset = gstbt_sim_syn_reset;*/
@@ -798,7 +2615,8 @@ G_DIR_SEPARATOR_S "" PACKAGE "-gst" G_DIR_SEPARATOR_S "GstBtSimSyn.html");*/
   properties[PROP_STEREO] =
     g_param_spec_float("stereo", "Stereo", "Stereo Width", 0, 1, 0.25, flags);
   properties[PROP_VIRTUAL_VOICES] =
-    g_param_spec_uint("virtual-voices", "Virt. Voice", "Virtual Voices", 1, MAX_VIRTUAL_VOICES, 1, flags);
+    g_param_spec_uint("virtual-voices", "Virt. Voice", "Virtual Voices", 1, MAX_VIRTUAL_VOICES, 1,
+                      flags & ~GST_PARAM_CONTROLLABLE);
   properties[PROP_RELEASE_ON_NOTE] =
     g_param_spec_boolean("release-on-note", "Rel On Note", "Release virtual voice on each note", TRUE, flags);
   properties[PROP_VOL] =
@@ -809,6 +2627,35 @@ G_DIR_SEPARATOR_S "" PACKAGE "-gst" G_DIR_SEPARATOR_S "GstBtSimSyn.html");*/
 
   properties[PROP_ANTICLICK] =
     g_param_spec_float("anticlick", "Anti-click", "Anti-click", 0, 1, 0.05, flags);
+
+  // Only affects S16 output. Not controllable, as it's a setting of the output rather than of the sound.
+  properties[PROP_DITHER] =
+    g_param_spec_boolean("dither", "Dither", "TPDF dither when producing 16-bit integer output", TRUE,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+  
+  properties[PROP_INTERNAL_BLOCK_FRAMES] =
+    g_param_spec_uint("internal-block-frames", "Internal Block Frames",
+                      "Render in blocks of this many frames, independent of the buffer size. 0 renders whole buffers.",
+                      0, MAX_BLOCK_FRAMES, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+
+  properties[PROP_CONTROL_RATE_DIVISOR] =
+    g_param_spec_uint("control-rate-divisor", "Control Rate Divisor",
+                      "Evaluate envelopes and LFOs every this many samples and interpolate between. 1 is every sample.",
+                      1, MAX_CONTROL_RATE_DIVISOR, 1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+
+  properties[PROP_PARTIAL_RAMP_FRAMES] =
+    g_param_spec_uint("partial-ramp-frames", "Partial Ramp Frames",
+                      "Evaluate each overtone's frequency and amplitude every this many samples and ramp between. "
+                      "Rounded up to a multiple of 4. 0 evaluates every sample.",
+                      0, MAX_PARTIAL_RAMP_FRAMES, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
+
+#ifdef USE_DEBUG
+  properties[PROP_RT_ALLOCATIONS] =
+    g_param_spec_uint64("rt-allocations", "RT Allocations",
+                        "Debug builds only. Number of heap calls made while rendering. Needs the plugin to be preloaded, "
+                        "and is the maximum value if it wasn't, as nothing is counted.",
+                        0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+#endif
   
   for (int i = 1; i < N_PROPERTIES; ++i)
     g_assert(properties[i]);
@@ -819,5 +2666,16 @@ G_DIR_SEPARATOR_S "" PACKAGE "-gst" G_DIR_SEPARATOR_S "GstBtSimSyn.html");*/
   gst_element_class_add_static_pad_template (element_class, &pad_template);
 
   math_test();
+  kernel_ramp_test();
+  srate_segs_test();
+  event_frame_test();
+#ifdef USE_DEBUG
+  // These make objects, so they're left out of the registration that every plugin scan does in other builds.
+  gstbt_adsr_test();
+  gstbt_lfo_float_test();
+
+  if (!rt_check_live())
+    GST_WARNING("The plugin wasn't preloaded, so rt-allocations can't count heap use while rendering");
+#endif
 }
 
@@ -29,11 +29,7 @@ struct _GstBtAdsrClass {
   GstBtPropSrateControlSource parent;
 };
   
-struct _GstBtAdsr {
-  GstBtPropSrateControlSource parent;
-
-  const char* postfix;
-  
+typedef struct {
   gfloat attack_level;
   gfloat attack_secs;
   gfloat attack_pow;
@@ -43,6 +39,16 @@ struct _GstBtAdsr {
   gfloat release_secs;
   gfloat release_pow;
   gboolean auto_release;
+} GstBtAdsrParams;
+
+struct _GstBtAdsr {
+  GstBtPropSrateControlSource parent;
+
+  const char* postfix;
+
+  // The properties set on this envelope. "params" points to them unless they're shared from another envelope.
+  GstBtAdsrParams params_own;
+  const GstBtAdsrParams* params;
 
   gfloat on_level;
   gfloat off_level;
@@ -53,128 +59,105 @@ struct _GstBtAdsr {
   GstClockTime ts_release;
   GstClockTime ts_off_end;
   gboolean released;
-
-  v4ui ts_zero_end4;
-  v4ui ts_trigger4;
-  v4ui ts_attack_end4;
-  v4ui ts_decay_end4;
-  v4ui ts_release4;
-  v4ui ts_off_end4;
   
   BtPropertiesSimple* props;
 };
 
 G_DEFINE_TYPE(GstBtAdsr, gstbt_adsr, gstbt_prop_srate_cs_get_type());
 
+// The envelope's own properties, for when it's used by itself as a control source. Its other properties follow.
+enum {
+  PROP_TRIGGER = 1,
+  PROP_RELEASE,
+  N_PROPERTIES
+};
 
-static inline v4sf ab_select4(v4sf a, v4sf b, v4ui timeb, v4ui time) {
-  return bitselect4f(time < timeb, a, b);
-}
-
-static inline gfloat lerp_knee(gfloat a, gfloat b,
-							   GstClockTime timea, GstClockTime timeb,
-							   GstClockTime time,
-							   gfloat knee) {
-  const gfloat alpha = MIN(1.0, MAX(0.0, ((float)(time - timea) / (timeb - timea) - knee)) / (1.0-knee));
+// Index of the first of "n_values" frames, starting at "timestamp", that's at or after "ts".
+static guint frame_at(const GstClockTime timestamp, const GstClockTime interval, const guint n_values,
+                      const GstClockTime ts) {
+  if (ts <= timestamp)
+    return 0;
   
-  return a + (b-a) * alpha;
-}
-
-static inline v4sf plerp4(v4sf a, v4sf b, v4ui timea, v4ui timeb, v4ui time, v4sf exp) {
-  const v4ui clamptime = clamp4ui(time, timea, timeb);
-  const v4sf alpha = __builtin_convertvector(clamptime - timea, v4sf) / __builtin_convertvector(timeb - timea, v4sf);
+  const GstClockTime diff = ts - timestamp;
+  if (interval == 0 || diff > interval * n_values)
+    return n_values;
   
-  return bitselect4f(timea == timeb, a, a + (b-a) * powpnz4f(alpha, exp));
-}
-
-static inline v4sf func_reset4(const GstBtAdsr* const self, const v4ui ts) {
-  return plerp4(self->on_level * V4SF_UNIT, V4SF_ZERO, self->ts_trigger4, self->ts_zero_end4,
-                ts, V4SF_UNIT);
-}
-
-static inline v4sf func_attack4(const GstBtAdsr* const self, const v4ui ts) {
-  return plerp4(V4SF_ZERO, self->attack_level * V4SF_UNIT, self->ts_zero_end4,
-                self->ts_attack_end4, ts, self->attack_pow * V4SF_UNIT);
-}
-
-static inline v4sf func_decay4(const GstBtAdsr* const self, const v4ui ts) {
-  return plerp4(self->attack_level * V4SF_UNIT, self->sustain_level * V4SF_UNIT, self->ts_attack_end4,
-                self->ts_decay_end4, ts, self->decay_pow * V4SF_UNIT);
+  return MIN(n_values, (guint)((diff + interval - 1) / interval));
 }
 
-static inline v4sf func_sustain4(const GstBtAdsr* const self) {
-  return self->sustain_level * V4SF_UNIT;
-}
-
-static inline v4sf func_release4(const GstBtAdsr* const self, const v4ui ts) {
-  return plerp4(self->off_level * V4SF_UNIT, V4SF_ZERO, self->ts_release4, self->ts_off_end4, ts,
-                self->release_pow * V4SF_UNIT);
-}
-
-// Note: this was an experiment in branchless logic and is likely not actually faster than branch prediction!
-static inline v4sf get_value_inline4(const GstBtAdsr* const self, const v4ui ts) {
-  return ab_select4(
-	func_reset4(self, ts),
-	ab_select4(
-	  func_attack4(self, ts),
-	  ab_select4(
-		func_decay4(self, ts),
-		ab_select4(
-		  func_sustain4(self),
-		  func_release4(self, ts),
-		  self->ts_release4,
-		  ts),
-		self->ts_decay_end4,
-		ts),
-	  self->ts_attack_end4,
-	  ts),
-	self->ts_zero_end4,
-	ts);
+// Appends the part of a stage running from "a" at "ts_a" to "b" at "ts_b" that falls within the block. Stages must
+// be added in order, and an empty stage adds nothing.
+static guint stage_add(SrateSeg* const segs, const guint n_segs, const GstClockTime timestamp,
+                       const GstClockTime interval, const guint n_values, const GstClockTime ts_a,
+                       const GstClockTime ts_b, const gfloat a, const gfloat b, const gfloat exp) {
+  const guint start = n_segs == 0 ? 0 : segs[n_segs-1].end;
+  const guint end = frame_at(timestamp, interval, n_values, ts_b);
+  if (end <= start)
+    return n_segs;
+
+  SrateSeg* const seg = &segs[n_segs];
+  seg->end = end;
+  seg->base = a;
+  seg->range = b - a;
+  seg->exp = exp;
+  seg->kind = a == b ? SRATE_SEG_CONST : exp == 1 ? SRATE_SEG_LINEAR : SRATE_SEG_POW;
+
+  if (ts_b > ts_a && ts_b != GST_CLOCK_TIME_NONE) {
+    const gdouble len = ts_b - ts_a;
+    seg->alpha = GST_CLOCK_DIFF(ts_a, timestamp + start * interval) / len;
+    seg->alpha_inc = interval / len;
+  } else {
+    seg->alpha = 0;
+    seg->alpha_inc = 0;
+  }
+  
+  return n_segs + 1;
 }
 
-gboolean gstbt_adsr_get_value_array_f(GstBtPropSrateControlSource* super, GstClockTime timestamp, GstClockTime interval,
-                                      guint n_values, gfloat* values) {
-  g_assert(n_values % 4 == 0);
-  
+// The envelope as one segment per stage that overlaps the block, after a silent one if the block starts before the
+// trigger, so that the attack starts on the trigger's frame.
+static guint get_segments(GstBtPropSrateControlSource* super, GstClockTime timestamp, GstClockTime interval,
+                          guint n_values, SrateSeg* segs) {
   GstBtAdsr* self = (GstBtAdsr*)super;
 
-  if (timestamp > self->ts_off_end || timestamp < self->ts_trigger) {
-    for (gint i = 0; i < n_values; ++i)
-      values[i] = 0;
-    return FALSE;
+  if (timestamp > self->ts_off_end || timestamp + n_values * interval <= self->ts_trigger) {
+    segs[0] = (SrateSeg){.end = n_values, .kind = SRATE_SEG_CONST};
+    return 1;
   }
 
-  const v4ui inc = {0,1,2,3};
-  v4ui inc2 = {4,3,2,1};
-  const guint uint_interval = (guint)(interval/1e2L);
-  inc2 *= uint_interval;
-  
-  v4si accum = V4SI_ZERO;
-  v4sf* const values4 = (v4sf*)values;
-  v4ui ts = (guint)((timestamp - self->ts_trigger)/1e2L) + inc * uint_interval;
-  for (guint i = 0; i < n_values/4; ++i) {
-	values4[i] = get_value_inline4(self, ts);
-	accum = (accum != V4SI_ZERO) | (values4[i] != V4SF_ZERO);
-	ts += inc2;
+  guint n = 0;
+  if (timestamp < self->ts_trigger) {
+    segs[0] = (SrateSeg){.end = frame_at(timestamp, interval, n_values, self->ts_trigger), .kind = SRATE_SEG_CONST};
+    n = 1;
   }
-
-  return !v4si_eq(accum, V4SI_ZERO);
+  
+  n = stage_add(segs, n, timestamp, interval, n_values, self->ts_trigger, self->ts_zero_end,
+                self->on_level, 0, 1);
+  n = stage_add(segs, n, timestamp, interval, n_values, self->ts_zero_end, self->ts_attack_end,
+                0, self->params->attack_level, self->params->attack_pow);
+  n = stage_add(segs, n, timestamp, interval, n_values, self->ts_attack_end, self->ts_decay_end,
+                self->params->attack_level, self->params->sustain_level, self->params->decay_pow);
+  n = stage_add(segs, n, timestamp, interval, n_values, self->ts_decay_end, self->ts_release,
+                self->params->sustain_level, self->params->sustain_level, 1);
+  n = stage_add(segs, n, timestamp, interval, n_values, self->ts_release, self->ts_off_end,
+                self->off_level, 0, self->params->release_pow);
+  n = stage_add(segs, n, timestamp, interval, n_values, self->ts_off_end, GST_CLOCK_TIME_NONE,
+                0, 0, 1);
+  return n;
 }
 
-static gboolean get_value_array(GstControlSource* super, GstClockTime timestamp, GstClockTime interval,
-								guint n_values, gdouble* values) {
-  for (guint i = 0; i < n_values; ++i) {
-    v4sf fval;
-	gstbt_adsr_get_value_array_f((GstBtPropSrateControlSource*)super, timestamp, 0, 4, (float*)&fval);
-    values[i] = fval[0];
-	timestamp += interval;
-  }
-  return TRUE;
-}
+// Each run of frames in a stage is filled with only that stage's curve, and constant runs with their value.
+gboolean gstbt_adsr_get_value_array_f(GstBtPropSrateControlSource* super, GstClockTime timestamp, GstClockTime interval,
+                                      guint n_values, gfloat* values) {
+  SrateSeg segs[SRATE_SEGS_MAX];
+  const guint n_segs = get_segments(super, timestamp, interval, n_values, segs);
 
-static gboolean get_value(GstControlSource* super, GstClockTime timestamp, gdouble* value) {
-  get_value_array(super, timestamp, 0, 1, value);
-  return TRUE;
+  SrateBufDesc desc;
+  srate_segs_render(segs, n_segs, &desc, values, n_values);
+  // A trailing partial group of 4 is written in full; the caller's buffer must have room for it.
+  srate_buf_materialise(&desc, values, n_values);
+  
+  return !srate_buf_is_zero(&desc);
 }
 
 void gstbt_adsr_get_value_f(GstBtPropSrateControlSource* super, GstClockTime timestamp, gfloat* value) {
@@ -191,17 +174,57 @@ gboolean gstbt_adsr_property_get(GObject* obj, guint prop_id, GValue* value, GPa
   return bt_properties_simple_get(((GstBtAdsr*)obj)->props, pspec, value);
 }
 
+static void property_set(GObject* obj, guint prop_id, const GValue* value, GParamSpec* pspec) {
+  GstBtAdsr* const self = (GstBtAdsr*)obj;
+  
+  switch (prop_id) {
+  case PROP_TRIGGER:
+    gstbt_adsr_trigger(self, g_value_get_uint64(value), 0);
+    break;
+  case PROP_RELEASE:
+    gstbt_adsr_off(self, g_value_get_uint64(value));
+    break;
+  default:
+    if (!gstbt_adsr_property_set(obj, prop_id, value, pspec))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
+  }
+}
+
+static void property_get(GObject* obj, guint prop_id, GValue* value, GParamSpec* pspec) {
+  if (!gstbt_adsr_property_get(obj, prop_id, value, pspec))
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
+}
+
 static void dispose(GObject* obj) {
   g_clear_object(&((GstBtAdsr*)obj)->props);
+  G_OBJECT_CLASS(gstbt_adsr_parent_class)->dispose(obj);
 }
 
 void gstbt_adsr_class_init(GstBtAdsrClass* const klass) {
   GObjectClass* const gobject_class = (GObjectClass*)klass;
+  gobject_class->set_property = property_set;
+  gobject_class->get_property = property_get;
   gobject_class->dispose = dispose;
 
+  // Used by itself, the envelope is triggered and released at stream times by setting these.
+  g_object_class_install_property(
+    gobject_class,
+    PROP_TRIGGER,
+    g_param_spec_uint64("trigger", "Trigger", "Starts the envelope at this time", 0, G_MAXUINT64, 0,
+                        G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property(
+    gobject_class,
+    PROP_RELEASE,
+    g_param_spec_uint64("release", "Release", "Releases the envelope at this time", 0, G_MAXUINT64, 0,
+                        G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
+
+  guint idx = N_PROPERTIES;
+  gstbt_adsr_props_add(gobject_class, "", &idx);
+
   GstBtPropSrateControlSourceClass* const klass_cs = (GstBtPropSrateControlSourceClass*)klass;
   klass_cs->get_value_f = gstbt_adsr_get_value_f;
   klass_cs->get_value_array_f = gstbt_adsr_get_value_array_f;
+  klass_cs->get_segments = get_segments;
 }
 
 void gstbt_adsr_props_add(GObjectClass* const klass, const char* postfix, guint* idx) {
@@ -276,9 +299,8 @@ void gstbt_adsr_props_add(GObjectClass* const klass, const char* postfix, guint*
   g_string_free(str, TRUE);
 }
 
-void gstbt_adsr_init(GstBtAdsr* const self) {
-  self->parent.parent_instance.get_value = get_value;
-  self->parent.parent_instance.get_value_array = get_value_array;
+void gstbt_adsr_share_params(GstBtAdsr* const self, const GstBtAdsr* const master) {
+  self->params = &master->params_own;
 }
 
 void gstbt_adsr_off(GstBtAdsr* const self, const GstClockTime time) {
@@ -289,15 +311,10 @@ void gstbt_adsr_off(GstBtAdsr* const self, const GstClockTime time) {
   
   gstbt_adsr_get_value_f((GstBtPropSrateControlSource*)self, time, &self->off_level);
   self->ts_zero_end = MIN(self->ts_zero_end, time);
-  self->ts_zero_end4 = (guint)((self->ts_zero_end - self->ts_trigger)/1e2L) * V4UI_UNIT;
   self->ts_attack_end = MIN(self->ts_attack_end, time);
-  self->ts_attack_end4 = (guint)((self->ts_attack_end - self->ts_trigger)/1e2L) * V4UI_UNIT;
   self->ts_decay_end = MIN(self->ts_decay_end, time);
-  self->ts_decay_end4 = (guint)((self->ts_decay_end - self->ts_trigger)/1e2L) * V4UI_UNIT;
   self->ts_release = time;
-  self->ts_release4 = (guint)((self->ts_release - self->ts_trigger)/1e2L) * V4UI_UNIT;
-  self->ts_off_end = self->ts_release + (GstClockTime)(self->release_secs * GST_SECOND);
-  self->ts_off_end4 = (guint)((self->ts_off_end - self->ts_trigger)/1e2L) * V4UI_UNIT;
+  self->ts_off_end = self->ts_release + (GstClockTime)(self->params->release_secs * GST_SECOND);
 }
 
 void gstbt_adsr_trigger(GstBtAdsr* const self, const GstClockTime time, gfloat anticlick) {
@@ -307,7 +324,6 @@ void gstbt_adsr_trigger(GstBtAdsr* const self, const GstClockTime time, gfloat a
   gstbt_adsr_get_value_f((GstBtPropSrateControlSource*)self, time, &onlevel);
   
   self->ts_trigger = time;
-  self->ts_trigger4 = V4UI_ZERO;
   
   if (envelope_never_triggered) {
 	self->ts_zero_end = self->ts_trigger;
@@ -315,43 +331,69 @@ void gstbt_adsr_trigger(GstBtAdsr* const self, const GstClockTime time, gfloat a
     self->on_level = onlevel;
 	self->ts_zero_end = self->ts_trigger + (GstClockTime)(self->on_level * anticlick * GST_SECOND);
   }
-  self->ts_zero_end4 = (guint)((self->ts_zero_end - time)/1e2L) * V4UI_UNIT;
   
-  self->ts_attack_end = self->ts_zero_end + (GstClockTime)(self->attack_secs * GST_SECOND);
-  self->ts_attack_end4 = (guint)((self->ts_attack_end - self->ts_trigger)/1e2L) * V4UI_UNIT;
-  self->ts_decay_end = self->ts_attack_end + (GstClockTime)(self->decay_secs * GST_SECOND);
-  self->ts_decay_end4 = (guint)((self->ts_decay_end - self->ts_trigger)/1e2L) * V4UI_UNIT;
+  self->ts_attack_end = self->ts_zero_end + (GstClockTime)(self->params->attack_secs * GST_SECOND);
+  self->ts_decay_end = self->ts_attack_end + (GstClockTime)(self->params->decay_secs * GST_SECOND);
   self->ts_release = ULONG_MAX;
-  self->ts_release4 = V4UI_TRUE;
   self->ts_off_end = ULONG_MAX;
-  self->ts_off_end4 = V4UI_TRUE;
 
   self->released = FALSE;
   
-  if (self->auto_release) {
+  if (self->params->auto_release) {
     gstbt_adsr_off(self, self->ts_decay_end);
   }
 }
 
-void prop_add(GstBtAdsr* const self, const char* name, void* var) {
+static void prop_add(GstBtAdsr* const self, const char* name, void* var) {
   GString* str = g_string_new(name);
   g_string_append(str, self->postfix);
   bt_properties_simple_add(self->props, str->str, var);
   g_string_free(str, TRUE);
 }
 
+// Binds the envelope's parameters to the properties of "owner", which has them installed with the envelope's postfix.
+static void props_bind(GstBtAdsr* const self, GObject* const owner) {
+  g_clear_object(&self->props);
+  self->props = bt_properties_simple_new(owner);
+  prop_add(self, "attack-level", &self->params_own.attack_level);
+  prop_add(self, "attack-secs", &self->params_own.attack_secs);
+  prop_add(self, "attack-pow", &self->params_own.attack_pow);
+  prop_add(self, "sustain-level", &self->params_own.sustain_level);
+  prop_add(self, "decay-secs", &self->params_own.decay_secs);
+  prop_add(self, "decay-pow", &self->params_own.decay_pow);
+  prop_add(self, "release-secs", &self->params_own.release_secs);
+  prop_add(self, "release-pow", &self->params_own.release_pow);
+  prop_add(self, "auto-release", &self->params_own.auto_release);
+}
+
 GstBtAdsr* gstbt_adsr_new(GObject* owner, const char* property_postfix) {
-  GstBtAdsr* result = g_object_new(gstbt_adsr_get_type(), NULL);
-  result->props = bt_properties_simple_new(owner);
+  GstBtAdsr* result = gst_object_ref_sink(g_object_new(gstbt_adsr_get_type(), NULL));
   result->postfix = property_postfix;
-  prop_add(result, "attack-level", &result->attack_level);
-  prop_add(result, "attack-secs", &result->attack_secs);
-  prop_add(result, "attack-pow", &result->attack_pow);
-  prop_add(result, "sustain-level", &result->sustain_level);
-  prop_add(result, "decay-secs", &result->decay_secs);
-  prop_add(result, "decay-pow", &result->decay_pow);
-  prop_add(result, "release-secs", &result->release_secs);
-  prop_add(result, "release-pow", &result->release_pow);
-  prop_add(result, "auto-release", &result->auto_release);
+  props_bind(result, owner);
   return result;
 }
+
+void gstbt_adsr_init(GstBtAdsr* const self) {
+  self->params = &self->params_own;
+  // Until gstbt_adsr_new gives it an owner, the envelope's parameters are its own properties.
+  self->postfix = "";
+  props_bind(self, (GObject*)self);
+}
+
+void gstbt_adsr_test(void) {
+  GstBtAdsr* const adsr = gst_object_ref_sink(g_object_new(gstbt_adsr_get_type(), NULL));
+  g_object_set(adsr, "attack-level", 1.0f, "attack-secs", 0.01f, "attack-pow", 1.0f, NULL);
+
+  // Triggered halfway between frames 37 and 38 of a request that the standalone path reads in several chunks.
+  const GstClockTime interval = GST_SECOND / 1000;
+  g_object_set(adsr, "trigger", (guint64)(37 * interval + interval / 2), NULL);
+
+  gdouble values[128];
+  g_assert(gst_control_source_get_value_array((GstControlSource*)adsr, 0, interval, G_N_ELEMENTS(values), values));
+  for (guint i = 0; i < 38; ++i)
+    g_assert(values[i] == 0);
+  g_assert(values[38] > 0);
+  g_assert(values[39] > values[38]);
+
+  gst_object_unref(adsr);
+}
@@ -25,6 +25,13 @@ GstBtAdsr* gstbt_adsr_new(GObject* owner, const char* property_postfix);
 void gstbt_adsr_props_add(GObjectClass* const klass, const char* postfix, guint* idx);
 void gstbt_adsr_trigger(GstBtAdsr* const self, const GstClockTime time, gfloat anticlick);
 void gstbt_adsr_off(GstBtAdsr* const self, const GstClockTime time);
+// Makes the envelope follow "master"'s properties rather than its own. Its state, such as the last trigger time, is
+// still its own.
+void gstbt_adsr_share_params(GstBtAdsr* const self, const GstBtAdsr* const master);
 
 gboolean gstbt_adsr_property_set(GObject* obj, guint prop_id, const GValue* value, GParamSpec* pspec);
 gboolean gstbt_adsr_property_get(GObject* obj, guint prop_id, GValue* value, GParamSpec* pspec);
+
+// Checks that the envelope used by itself starts on the frame it's triggered at. Aborts on failure. Run by debug
+// builds.
+void gstbt_adsr_test(void);
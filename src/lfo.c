@@ -22,12 +22,13 @@
 #include "src/genums.h"
 #include "src/math.h"
 #include "src/properties_simple.h"
+#include "src/sratebuf.h"
 #include "src/voice.h"
 #include "src/generated/generated-genums.h"
 
 #include <gst/gstparamspecs.h>
 
-struct _GstBtLfoFloat {
+typedef struct {
   guint idx_voice_master;
   GstbtLfoFloatProp voice_master_prop;
   gfloat amplitude;
@@ -39,24 +40,50 @@ struct _GstBtLfoFloat {
   GstBtLfoFloatWaveform waveform;
 
   gfloat c_frequency;
+} GstBtLfoFloatParams;
+
+// The buffer size of an LFO used by itself. Longer requests are made in pieces of this size.
+enum { OWN_BUF_SAMPLES = 64 };
+
+struct _GstBtLfoFloat {
+  GstBtPropSrateControlSource parent;
+  
+  // The properties set on this LFO. "params" points to them unless they're shared from another LFO.
+  GstBtLfoFloatParams params_own;
+  const GstBtLfoFloatParams* params;
+
   gfloat accum;
   gfloat integrate;
+  // When the LFO is used by itself, the time just after the last value it gave, or GST_CLOCK_TIME_NONE.
+  GstClockTime next_timestamp;
   
   BtPropertiesSimple* props;
   GObject* owner;
   guint idx_voice;
   guint buf_srate_nsamples;
   v4sf* buf_srate_props;
-  gboolean props_srate_nonzero[GSTBT_LFO_FLOAT_PROP_N];
-  gboolean props_srate_controlled[GSTBT_LFO_FLOAT_PROP_N];
+  // Memory for "buf_srate_props" when the LFO is used by itself, and no voice gives it any. It's part of the
+  // instance so that the first standalone request doesn't allocate on the caller's streaming thread.
+  v4sf buf_own[OWN_BUF_SAMPLES / 4 * GSTBT_LFO_FLOAT_PROP_N];
+  SrateBufDesc srate_descs[GSTBT_LFO_FLOAT_PROP_N];
   guint32 noise_state;
   gfloat noise_cur;
 };
 
-G_DEFINE_TYPE(GstBtLfoFloat, gstbt_lfo_float, G_TYPE_OBJECT);
+G_DEFINE_TYPE(GstBtLfoFloat, gstbt_lfo_float, gstbt_prop_srate_cs_get_type());
 
 static GParamSpec* properties[GSTBT_LFO_FLOAT_PROP_N] = { NULL, };
 
+// The fields holding the value of each float property. The frequency is read after its curve is applied.
+static const glong prop_offsets[GSTBT_LFO_FLOAT_PROP_N] = {
+  [GSTBT_LFO_FLOAT_PROP_AMPLITUDE] = G_STRUCT_OFFSET(GstBtLfoFloatParams, amplitude),
+  [GSTBT_LFO_FLOAT_PROP_FREQUENCY] = G_STRUCT_OFFSET(GstBtLfoFloatParams, c_frequency),
+  [GSTBT_LFO_FLOAT_PROP_SHAPE] = G_STRUCT_OFFSET(GstBtLfoFloatParams, shape),
+  [GSTBT_LFO_FLOAT_PROP_FILTER] = G_STRUCT_OFFSET(GstBtLfoFloatParams, filter),
+  [GSTBT_LFO_FLOAT_PROP_OFFSET] = G_STRUCT_OFFSET(GstBtLfoFloatParams, offset),
+  [GSTBT_LFO_FLOAT_PROP_PHASE] = G_STRUCT_OFFSET(GstBtLfoFloatParams, phase)
+};
+
 // https://www.pcg-random.org/pdf/hmc-cs-2014-0905.pdf
 static const guint32 lcg_multiplier = 1103515245;
 static const guint32 lcg_increment = 12345;
@@ -114,61 +141,45 @@ static inline v4sf get_sample(const guint waveform, const v4sf accum_unbounded,
 static void srate_props_fill(GstBtLfoFloat* const self, const GstClockTime timestamp, const GstClockTime interval,
                              guint n_values, GstBtAdditiveV** voices) {
 
-  g_assert(self->buf_srate_nsamples);
+  g_assert(n_values <= self->buf_srate_nsamples);
   
   for (guint i = 0; i < GSTBT_LFO_FLOAT_PROP_N; ++i) {
-    GValue src = G_VALUE_INIT;
-
-    v4sf value;
-    if (i == GSTBT_LFO_FLOAT_PROP_FREQUENCY) {
-      value = V4SF_UNIT * self->c_frequency;
-    } else if (g_type_is_a(properties[i]->value_type, G_TYPE_ENUM)) {
-      g_value_init(&src, G_TYPE_UINT);
-      g_object_get_property((GObject*)self->owner, properties[i]->name, &src);
-      value = (gfloat)g_value_get_uint(&src) * V4SF_UNIT;
-    } else {
-      g_value_init(&src, G_TYPE_FLOAT);
-      g_object_get_property((GObject*)self->owner, properties[i]->name, &src);
-      value = g_value_get_float(&src) * V4SF_UNIT;
-    }
-    
-    g_value_unset(&src);
+    const gfloat value =
+      i == GSTBT_LFO_FLOAT_PROP_WAVEFORM ?
+      (gfloat)self->params->waveform :
+      G_STRUCT_MEMBER(gfloat, self->params, prop_offsets[i]);
 
-    v4sf* const sratebuf = &self->buf_srate_props[self->buf_srate_nsamples/4*i];
-    for (guint j = 0; j < n_values/4; ++j) {
-      sratebuf[j] = value;
-    }
+    // Only the first group is written unless the property is modulated.
+    srate_buf_init_const(&self->srate_descs[i], (gfloat*)&self->buf_srate_props[self->buf_srate_nsamples/4*i], value);
   }
 
-  memset(self->props_srate_nonzero, 0, sizeof(self->props_srate_nonzero));
-  memset(self->props_srate_controlled, 0, sizeof(self->props_srate_controlled));
-
-  if (voices && self->idx_voice_master != -1 && self->voice_master_prop != GSTBT_LFO_FLOAT_PROP_NONE) {
+  // Voices beyond the machine's number of children don't exist.
+  if (voices && self->params->idx_voice_master < MAX_VOICES && voices[self->params->idx_voice_master] &&
+      self->params->voice_master_prop != GSTBT_LFO_FLOAT_PROP_NONE) {
 
     // Note: only modulate with LFO if "voice master" isn't set to reference itself.
     // In that case, the ADSR of the current voice will modulate, but not the LFO.
     gstbt_additivev_mod_value_array_f_for_prop_idx(
-      voices[self->idx_voice_master],
+      voices[self->params->idx_voice_master],
       timestamp,
       interval,
-      self->buf_srate_nsamples,
+      n_values,
       (gfloat*)self->buf_srate_props,
-      self->props_srate_nonzero,
-      self->props_srate_controlled,
+      self->srate_descs,
       voices,
-      (guint)self->voice_master_prop,
-      self->idx_voice_master != self->idx_voice
+      (guint)self->params->voice_master_prop,
+      self->params->idx_voice_master != self->idx_voice
       );
   }
 }
 
 static gboolean mod_value_array_accum(GstBtLfoFloat* self, GstClockTime timestamp, GstClockTime interval,
                                       gfloat* values, guint n_values, GstBtAdditiveV** voices) {
-  g_assert(self->c_frequency != 0);
-  if (self->amplitude == 0)
+  g_assert(self->params->c_frequency != 0);
+  if (self->params->amplitude == 0)
 	return FALSE;
 
-  g_assert(n_values % 4 == 0);
+  g_assert(n_values > 0);
   
   srate_props_fill(self, timestamp, interval, n_values, voices);
   
@@ -179,6 +190,14 @@ static gboolean mod_value_array_accum(GstBtLfoFloat* self, GstClockTime timestam
   const v4sf* const srate_offset = &self->buf_srate_props[self->buf_srate_nsamples/4*GSTBT_LFO_FLOAT_PROP_OFFSET];
   const v4sf* const srate_phase = &self->buf_srate_props[self->buf_srate_nsamples/4*GSTBT_LFO_FLOAT_PROP_PHASE];
   const v4sf* const srate_waveform = &self->buf_srate_props[self->buf_srate_nsamples/4*GSTBT_LFO_FLOAT_PROP_WAVEFORM];
+
+  // Unmodulated properties are constant and only their first group is written.
+  const guint mask_amplitude = srate_buf_mask(&self->srate_descs[GSTBT_LFO_FLOAT_PROP_AMPLITUDE]);
+  const guint mask_frequency = srate_buf_mask(&self->srate_descs[GSTBT_LFO_FLOAT_PROP_FREQUENCY]);
+  const guint mask_shape = srate_buf_mask(&self->srate_descs[GSTBT_LFO_FLOAT_PROP_SHAPE]);
+  const guint mask_filter = srate_buf_mask(&self->srate_descs[GSTBT_LFO_FLOAT_PROP_FILTER]);
+  const guint mask_offset = srate_buf_mask(&self->srate_descs[GSTBT_LFO_FLOAT_PROP_OFFSET]);
+  const guint mask_phase = srate_buf_mask(&self->srate_descs[GSTBT_LFO_FLOAT_PROP_PHASE]);
   
   v4si any_nonzero = V4SI_ZERO;
   v4sf* const out = (v4sf*)values;
@@ -189,20 +208,28 @@ static gboolean mod_value_array_accum(GstBtLfoFloat* self, GstClockTime timestam
 
   const v4sf inc_base = (gfloat)interval/GST_SECOND * period;
   const guint waveform = srate_waveform[0][0];
+
+  // A trailing partial group is computed in full, but the LFO's state must be kept from the last requested value so
+  // that it continues seamlessly in the next call.
+  const guint n4_values = n4_ceil(n_values);
+  const guint idx_last = (n_values - 1) % 4;
+  gfloat accum_next = 0;
+  gfloat integrate_next = 0;
   
-  for (guint i = 0; i < n_values/4; ++i) {
-    const v4sf inc = inc_base * srate_frequency[i];
+  for (guint i = 0; i < n4_values; ++i) {
+    const v4sf inc = inc_base * srate_frequency[i & mask_frequency];
     
     accum4[1] = accum4[0] + inc[0];
     accum4[2] = accum4[1] + inc[1];
     accum4[3] = accum4[2] + inc[2];
     
-    const v4sf alpha = pow4f(srate_filter[i], 8 * V4SF_UNIT);
+    const v4sf alpha = pow4f(srate_filter[i & mask_filter], 8 * V4SF_UNIT);
   
 	const v4sf val =
-      srate_offset[i] +
-      get_sample(waveform, accum4 + srate_phase[i], srate_shape[i], accum4, &self->noise_state, &self->noise_cur) *
-      srate_amplitude[i];
+      srate_offset[i & mask_offset] +
+      get_sample(waveform, accum4 + srate_phase[i & mask_phase], srate_shape[i & mask_shape], accum4,
+                 &self->noise_state, &self->noise_cur) *
+      srate_amplitude[i & mask_amplitude];
 
     v4sf integrate = alpha*val;
     integrate[0] += (1 - alpha[0]) * self->integrate;
@@ -214,33 +241,91 @@ static gboolean mod_value_array_accum(GstBtLfoFloat* self, GstClockTime timestam
     out[i] *= integrate;
     
 	any_nonzero = (any_nonzero != 0) | (out[i] != 0);
-    
+
+    accum_next = accum4[idx_last] + inc[idx_last];
+    integrate_next = integrate[idx_last];
 	accum4[0] = accum4[3] + inc[3];
   }
-  
-  self->accum = fmod(accum4[0], period[0]);
+
+  self->integrate = integrate_next;
+  self->accum = fmod(accum_next, period[0]);
   
   return !v4si_eq(any_nonzero, V4SI_ZERO);
 }
 
+gboolean gstbt_lfo_float_is_active(const GstBtLfoFloat* const self) {
+  return self->params->amplitude != 0;
+}
+
 gboolean gstbt_lfo_float_mod_value_array_accum(GstBtLfoFloat* self, GstClockTime timestamp, GstClockTime interval,
                                                gfloat* values, guint n_values, GstBtAdditiveV** voices) {
   return mod_value_array_accum(self, timestamp, interval, values, n_values, voices);
 }
 
+void gstbt_lfo_float_advance(GstBtLfoFloat* const self, const GstClockTime interval, const guint n_values) {
+  const gdouble elapsed = (gdouble)(n_values * interval) / GST_SECOND;
+  self->accum = fmod(self->accum + elapsed * self->params->c_frequency, 1.0);
+}
+
+// Advances the phase of an LFO used by itself to "timestamp", by the time since the last value it gave. Requests
+// needn't be contiguous, e.g. a controller syncing once per buffer asks for a single value each time. An earlier
+// timestamp, such as after a seek, continues from the current phase.
+static void skip_to(GstBtLfoFloat* const self, const GstClockTime timestamp) {
+  if (GST_CLOCK_TIME_IS_VALID(self->next_timestamp) && timestamp > self->next_timestamp) {
+    const gdouble elapsed = (gdouble)(timestamp - self->next_timestamp) / GST_SECOND;
+    self->accum = fmod(self->accum + elapsed * self->params->c_frequency, 1.0);
+  }
+}
+
+// Fills "values" with what the LFO would multiply them by, which is 1 while it's inactive.
+static gboolean get_value_array_f(GstBtPropSrateControlSource* super, GstClockTime timestamp, GstClockTime interval,
+                                  guint n_values, gfloat* values) {
+  GstBtLfoFloat* const self = (GstBtLfoFloat*)super;
+
+  skip_to(self, timestamp);
+  self->next_timestamp = timestamp + n_values * interval;
+
+  for (guint i = 0; i < n4_ceil(n_values)*4; ++i)
+    values[i] = 1;
+
+  if (!gstbt_lfo_float_is_active(self))
+    return TRUE;
+
+  if (!self->buf_srate_props)
+    gstbt_lfo_float_buffer_set(self, OWN_BUF_SAMPLES, self->buf_own);
+
+  // The pieces are whole groups of 4, so each starts aligned.
+  gboolean nonzero = FALSE;
+  for (guint done = 0; done < n_values; done += self->buf_srate_nsamples) {
+    const guint n = MIN(self->buf_srate_nsamples, n_values - done);
+    nonzero = mod_value_array_accum(self, timestamp + done * interval, interval, values + done, n, NULL) || nonzero;
+  }
+  
+  return nonzero;
+}
+
+static void get_value_f(GstBtPropSrateControlSource* super, GstClockTime timestamp, gfloat* value) {
+  v4sf values;
+  get_value_array_f(super, timestamp, 0, 1, (gfloat*)&values);
+  *value = values[0];
+}
+
 gfloat elerp(gfloat start, gfloat end, gfloat base, gfloat x) {
   return -1+start+powf(1+end-start,powf(x,base));
 }
 
+// Range from 1 minute period to every sample period (possibly useful for noise).
+static void c_frequency_update(GstBtLfoFloat* const self) {
+  self->params_own.c_frequency = elerp(1.0/60.0, 44100, 2, self->params_own.frequency);
+}
+
 gboolean gstbt_lfo_float_property_set(GObject* obj, guint prop_id, const GValue* value, GParamSpec* pspec) {
   GstBtLfoFloat* self = (GstBtLfoFloat*)obj;
   gboolean result = bt_properties_simple_set(self->props, pspec, value);
 
-  // GSTBT_LFO_FLOAT_PROP_* indices are zero-based, as opposed to the 1-based GObject props.
-  if (prop_id-1 == GSTBT_LFO_FLOAT_PROP_FREQUENCY) {
-    // Range from 1 minute period to every sample period (possibly useful for noise).
-    self->c_frequency = elerp(1.0/60.0, 44100, 2, self->frequency);
-  }
+  // The property ids depend on the owner, so it's cheaper to always update than to work out which was set.
+  if (result)
+    c_frequency_update(self);
   
   return result;
 }
@@ -249,25 +334,58 @@ gboolean gstbt_lfo_float_property_get(GObject* obj, guint prop_id, GValue* value
   return bt_properties_simple_get(((GstBtLfoFloat*)obj)->props, pspec, value);
 }
 
+static void property_set(GObject* obj, guint prop_id, const GValue* value, GParamSpec* pspec) {
+  if (!gstbt_lfo_float_property_set(obj, prop_id, value, pspec))
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
+}
+
+static void property_get(GObject* obj, guint prop_id, GValue* value, GParamSpec* pspec) {
+  if (!gstbt_lfo_float_property_get(obj, prop_id, value, pspec))
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
+}
+
 static void dispose(GObject* obj) {
   GstBtLfoFloat* self = (GstBtLfoFloat*)obj;
   g_clear_object(&self->props);
-  g_clear_pointer(&self->buf_srate_props, g_free);
+  G_OBJECT_CLASS(gstbt_lfo_float_parent_class)->dispose(obj);
+}
+
+gsize gstbt_lfo_float_buffer_size(guint n_samples) {
+  return sizeof(gfloat) * n_samples * GSTBT_LFO_FLOAT_PROP_N;
 }
 
-void gstbt_lfo_float_on_buf_size_change(GstBtLfoFloat* self, guint n_samples) {
+void gstbt_lfo_float_buffer_set(GstBtLfoFloat* self, guint n_samples, gpointer mem) {
   g_assert(n_samples % 4 == 0);
+  g_assert((guintptr)mem % sizeof(v4sf) == 0);
   self->buf_srate_nsamples = n_samples;
-  self->buf_srate_props = g_realloc(self->buf_srate_props,
-                                    sizeof(gfloat) * self->buf_srate_nsamples * GSTBT_LFO_FLOAT_PROP_N);
+  self->buf_srate_props = mem;
 }
 
+static void props_bind(GstBtLfoFloat* self, GObject* owner);
+
 static void gstbt_lfo_float_init(GstBtLfoFloat* const self) {
+  self->params = &self->params_own;
+  self->next_timestamp = GST_CLOCK_TIME_NONE;
+  // Until gstbt_lfo_float_new gives it an owner, the LFO's parameters are its own properties.
+  props_bind(self, (GObject*)self);
+}
+
+void gstbt_lfo_float_share_params(GstBtLfoFloat* const self, const GstBtLfoFloat* const master) {
+  self->params = &master->params_own;
 }
 
 void gstbt_lfo_float_class_init(GstBtLfoFloatClass* const klass) {
   GObjectClass* const gobject_class = (GObjectClass*)klass;
+  gobject_class->set_property = property_set;
+  gobject_class->get_property = property_get;
   gobject_class->dispose = dispose;
+
+  GstBtPropSrateControlSourceClass* const klass_cs = (GstBtPropSrateControlSourceClass*)klass;
+  klass_cs->get_value_f = get_value_f;
+  klass_cs->get_value_array_f = get_value_array_f;
+
+  guint idx = 1;
+  gstbt_lfo_float_props_add(gobject_class, &idx);
 }
 
 void gstbt_lfo_float_props_add(GObjectClass* const gobject_class, guint* idx) {
@@ -303,19 +421,52 @@ void gstbt_lfo_float_props_add(GObjectClass* const gobject_class, guint* idx) {
   }
 }
 
+// Binds the LFO's parameters to the properties of "owner", which has them installed by gstbt_lfo_float_props_add.
+static void props_bind(GstBtLfoFloat* const self, GObject* const owner) {
+  g_clear_object(&self->props);
+  self->props = bt_properties_simple_new(owner);
+  bt_properties_simple_add(self->props, "lfo-voice-master", &self->params_own.idx_voice_master);
+  bt_properties_simple_add(self->props, "lfo-voice-master-prop", &self->params_own.voice_master_prop);
+  bt_properties_simple_add(self->props, "lfo-amplitude", &self->params_own.amplitude);
+  bt_properties_simple_add(self->props, "lfo-frequency", &self->params_own.frequency);
+  bt_properties_simple_add(self->props, "lfo-shape", &self->params_own.shape);
+  bt_properties_simple_add(self->props, "lfo-filter", &self->params_own.filter);
+  bt_properties_simple_add(self->props, "lfo-offset", &self->params_own.offset);
+  bt_properties_simple_add(self->props, "lfo-phase", &self->params_own.phase);
+  bt_properties_simple_add(self->props, "lfo-waveform", &self->params_own.waveform);
+  c_frequency_update(self);
+}
+
 GstBtLfoFloat* gstbt_lfo_float_new(GObject* const owner, const guint idx_voice) {
-  GstBtLfoFloat* result = g_object_new(gstbt_lfo_float_get_type(), NULL);
+  GstBtLfoFloat* result = gst_object_ref_sink(g_object_new(gstbt_lfo_float_get_type(), NULL));
   result->owner = owner;
   result->idx_voice = idx_voice;
-  result->props = bt_properties_simple_new(owner);
-  bt_properties_simple_add(result->props, "lfo-voice-master", &result->idx_voice_master);
-  bt_properties_simple_add(result->props, "lfo-voice-master-prop", &result->voice_master_prop);
-  bt_properties_simple_add(result->props, "lfo-amplitude", &result->amplitude);
-  bt_properties_simple_add(result->props, "lfo-frequency", &result->frequency);
-  bt_properties_simple_add(result->props, "lfo-shape", &result->shape);
-  bt_properties_simple_add(result->props, "lfo-filter", &result->filter);
-  bt_properties_simple_add(result->props, "lfo-offset", &result->offset);
-  bt_properties_simple_add(result->props, "lfo-phase", &result->phase);
-  bt_properties_simple_add(result->props, "lfo-waveform", &result->waveform);
+  props_bind(result, owner);
   return result;
 }
+
+void gstbt_lfo_float_test(void) {
+  GstBtLfoFloat* const lfo = gst_object_ref_sink(g_object_new(gstbt_lfo_float_get_type(), NULL));
+  GstBtPropSrateControlSource* const cs = (GstBtPropSrateControlSource*)lfo;
+  g_object_set(lfo, "lfo-amplitude", 1.0f, "lfo-frequency", 0.3f, NULL);
+
+  // Single values at different times, as a controller reads them, come from different phases.
+  gfloat a, b, c;
+  gstbt_prop_srate_cs_get_value_f(cs, 0, &a);
+  gstbt_prop_srate_cs_get_value_f(cs, 0, &b);
+  gstbt_prop_srate_cs_get_value_f(cs, GST_SECOND / 10, &c);
+  g_assert(a == b);
+  g_assert(fabsf(a - c) > 0.1f);
+
+  // Skipping ahead gets to where a run of values through the same time would have. "lfo" is at 100ms.
+  GstBtLfoFloat* const ref = gst_object_ref_sink(g_object_new(gstbt_lfo_float_get_type(), NULL));
+  g_object_set(ref, "lfo-amplitude", 1.0f, "lfo-frequency", 0.3f, NULL);
+  const GstClockTime interval = GST_SECOND / 1000;
+  v4sf run[204/4];
+  gstbt_prop_srate_cs_get_value_array_f((GstBtPropSrateControlSource*)ref, 0, interval, 201, (gfloat*)run);
+  gstbt_prop_srate_cs_get_value_f(cs, 200 * interval, &a);
+  g_assert(fabsf(((gfloat*)run)[200] - a) < 1e-3f);
+
+  gst_object_unref(ref);
+  gst_object_unref(lfo);
+}
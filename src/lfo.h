@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "src/propsratecontrolsource.h"
 #include "src/voice.h"
 
 /**
@@ -28,17 +29,31 @@
  * result given the current parameters. This can be useful when modulating the LFO's own parameters as it tends to
  * produce a "smoother" and more intuitive result, but on the other hand it's not possible to get the output at a given
  * time as it is with the control source approach.
+ *
+ * It can also be used by itself as a control source, with its properties set on it directly. Its values are then
+ * what it would multiply a voice's target by. Being an accumulator, it advances to each request's timestamp by the time
+ * since the last value it gave, so values must be requested in order, as a controller does.
  */
-G_DECLARE_FINAL_TYPE(GstBtLfoFloat, gstbt_lfo_float, GSTBT, LFO_FLOAT, GObject);
+G_DECLARE_FINAL_TYPE(GstBtLfoFloat, gstbt_lfo_float, GSTBT, LFO_FLOAT, GstBtPropSrateControlSource);
 
 GstBtLfoFloat* gstbt_lfo_float_new(GObject* owner, guint idx_voice);
 
 /**
  * The LFO needs a buffer of "s-rate" samples that will be used to modulate sound output, and/or other LFO outputs.
  * The size of this buffer will generally need to match the size of the buffer used for the sound output that the LFO
- * is modulating. It should be called before using the LFO and any time the main sound output buffer size changes.
- */ 
-void gstbt_lfo_float_on_buf_size_change(GstBtLfoFloat* self, guint n_samples);
+ * is modulating.
+ *
+ * The memory is owned by the caller, so that it can be allocated ahead of time along with other buffers. It must be
+ * at least gstbt_lfo_float_buffer_size bytes and aligned for v4sf. The buffer must be set before using the LFO, and
+ * again whenever the memory moves or the main sound output buffer size changes.
+ */
+gsize gstbt_lfo_float_buffer_size(guint n_samples);
+void gstbt_lfo_float_buffer_set(GstBtLfoFloat* self, guint n_samples, gpointer mem);
+
+/**
+ * Makes the LFO follow "master"'s properties rather than its own. Its state, such as its phase, is still its own.
+ */
+void gstbt_lfo_float_share_params(GstBtLfoFloat* self, const GstBtLfoFloat* master);
 
 /**
  * Can be used to add the LFO class properties to another class.
@@ -51,5 +66,21 @@ void gstbt_lfo_float_props_add(GObjectClass* const klass, guint* idx);
 gboolean gstbt_lfo_float_property_set(GObject* obj, guint prop_id, const GValue* value, GParamSpec* pspec);
 gboolean gstbt_lfo_float_property_get(GObject* obj, guint prop_id, GValue* value, GParamSpec* pspec);
 
+/**
+ * FALSE if the LFO would leave any values passed to gstbt_lfo_float_mod_value_array_accum unchanged.
+ */
+gboolean gstbt_lfo_float_is_active(const GstBtLfoFloat* self);
+
 gboolean gstbt_lfo_float_mod_value_array_accum(GstBtLfoFloat* self, GstClockTime timestamp, GstClockTime interval,
                                                gfloat* values, guint n_values, GstBtAdditiveV** voices);
+
+/**
+ * Moves the LFO's phase on by "n_values" samples without computing them, for when every value it would multiply is
+ * zero. Modulation of its frequency is ignored over those samples.
+ */
+void gstbt_lfo_float_advance(GstBtLfoFloat* self, GstClockTime interval, guint n_values);
+
+/**
+ * Checks that an LFO used by itself follows the timestamps it's asked for. Aborts on failure. Run by debug builds.
+ */
+void gstbt_lfo_float_test(void);
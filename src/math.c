@@ -338,4 +338,41 @@ void math_test(void) {
     v4sf result = ldexp4f(inputa, inputb);
     g_assert(v4sf_eq(result, expected));
   }
+
+  {
+    const v4sf inputs[] = {
+      {-2.5f, -1.5f, -0.5f, 0.5f},
+      {1.5f, 2.5f, -1.4f, 1.6f},
+      {0.49999997f, -0.49999997f, 0.0f, -0.0f},
+      {8388607.5f, -8388607.5f, 32767.0f, -32768.0f}
+    };
+    for (guint j = 0; j < G_N_ELEMENTS(inputs); ++j) {
+      v4si expected;
+      for (int i = 0; i < 4; ++i) {
+        expected[i] = (gint)lroundf(inputs[j][i]);
+      }
+      g_assert(v4si_eq(round4i(inputs[j]), expected));
+    }
+  }
+
+  {
+    v4sf input = {-60.0f, -6.0f, 0.0f, 30.0f};
+    v4sf result = db_to_gain4f(input);
+    for (int i = 0; i < 4; ++i) {
+      const gfloat expected = db_to_gain(input[i]);
+      g_assert(fabsf(result[i] - expected) <= expected * 1e-5f);
+    }
+  }
+
+  for (guint n = 0; n < 10; ++n) {
+    g_assert(n4_ceil(n) == (guint)ceil(n / 4.0));
+  }
+
+  {
+    gfloat out[6] = {-1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f};
+    v4sf input = {1.0f, 2.0f, 3.0f, 4.0f};
+    gfloat expected[6] = {-1.0f, 1.0f, 2.0f, 3.0f, 4.0f, -1.0f};
+    store4f_unaligned(out + 1, input);
+    g_assert(memcmp(out, expected, sizeof(out)) == 0);
+  }
 }
@@ -159,6 +159,17 @@ static inline v4sf clamp4f(v4sf x, v4sf min, v4sf max) {
   return min4f(max, max4f(x, min));
 }
 
+// The number of 4-float groups needed to cover n values. Functions that operate on groups of 4 process a trailing
+// partial group in full, so buffers must have room for a multiple of 4 values.
+static inline guint n4_ceil(const guint n) {
+  return (n + 3) / 4;
+}
+
+// Store to a destination that might not be 16-byte aligned, such as a buffer received from downstream.
+static inline void store4f_unaligned(gfloat* const dst, const v4sf v) {
+  memcpy(dst, &v, sizeof(v));
+}
+
 static inline gfloat lerp(const gfloat a, const gfloat b, const gfloat alpha) {
   return a + (b-a) * alpha;
 }
@@ -200,6 +211,17 @@ static inline v4sf trunc4f(const v4sf f) {
   return __builtin_convertvector(__builtin_convertvector(f, v4si), v4sf);
 }
 
+// Rounds to the nearest integer, with halves rounded away from zero. The input must be in range for gint.
+//
+// Adding 0.5 and truncating would be cheaper, but the sum is itself rounded: 0.49999997f + 0.5f gives 1.
+// Subtracting the truncated value is always exact, so the fraction can be tested instead.
+static inline v4si round4i(const v4sf f) {
+  const v4si t = __builtin_convertvector(f, v4si);
+  const v4sf frac = f - __builtin_convertvector(t, v4sf);
+  // The comparisons give -1 where true.
+  return t - (frac >= 0.5f) + (frac <= -0.5f);
+}
+
 static inline v4sf floor4f(const v4sf f) {
   v4sf t = trunc4f(f);
   return bitselect4f(t > f, t - 1, t);
@@ -303,6 +325,10 @@ static inline v4sf powb24f(const v4sf exponent) {
   return exp4f(exponent*0.6931471805599453f);
 }
 
+static inline v4sf db_to_gain4f(v4sf db) {
+  return exp4f(db * (gfloat)(M_LN10 / 20));
+}
+
 static inline v4sf sin4f_method(const v4sf x) {
   return sin4f(x);
   //return _ZGVbN4v_sinf(x);
@@ -26,8 +26,11 @@ struct _BtPropertiesSimpleClass {
   
 struct _BtPropertiesSimple {
   GObject parent;
-  GObject* owner;
+  // The class of the object whose properties these are. The object itself isn't referenced, as it usually owns this.
+  GObjectClass* owner_class;
   GArray* props;
+  // Index into "props" of each property by its GParamSpec param_id, or -1, so that lookups don't scan "props".
+  GArray* idx_by_id;
 };
 
 G_DEFINE_TYPE(BtPropertiesSimple, bt_properties_simple, G_TYPE_OBJECT);
@@ -35,86 +38,100 @@ G_DEFINE_TYPE(BtPropertiesSimple, bt_properties_simple, G_TYPE_OBJECT);
 typedef struct {
   GParamSpec* pspec;
   void* var;
+  // Typed accessors chosen when the property is added, so that gets and sets needn't switch on the value type.
+  void (*get)(const void* var, GValue* value);
+  void (*set)(void* var, const GValue* value);
 } PspecVar;
 
-gboolean bt_properties_simple_get(const BtPropertiesSimple* self, GParamSpec* pspec, GValue* value) {
-  for (guint i = 0; i < self->props->len; ++i) {
-    PspecVar* const pspec_var = &g_array_index(self->props, PspecVar, i);
-	
-    if (pspec_var->pspec->name == pspec->name) {
-      switch (pspec_var->pspec->value_type) {
-      case G_TYPE_BOOLEAN:
-        g_value_set_boolean(value, *(gboolean*)pspec_var->var);
-        break;
-      case G_TYPE_INT:
-        g_value_set_int(value, *(gint*)pspec_var->var);
-        break;
-      case G_TYPE_UINT:
-        g_value_set_uint(value, *(guint*)pspec_var->var);
-        break;
-      case G_TYPE_FLOAT:
-        g_value_set_float(value, *(gfloat*)pspec_var->var);
-        break;
-      case G_TYPE_DOUBLE:
-        g_value_set_double(value, *(gdouble*)pspec_var->var);
-        break;
-      default:
-        if (g_type_is_a(pspec_var->pspec->value_type, G_TYPE_ENUM))
-          g_value_set_enum(value, *(guint*)pspec_var->var);
-        else
-          g_assert(FALSE);
-      }
-      return TRUE;
-    }
+#define DEFINE_ACCESSORS(name, type, value_get, value_set)              \
+  static void get_##name(const void* var, GValue* value) {             \
+    value_set(value, *(const type*)var);                                \
+  }                                                                     \
+  static void set_##name(void* var, const GValue* value) {             \
+    *(type*)var = value_get(value);                                     \
   }
-  return FALSE;
-}
 
-static void bt_properties_simple_set_from_gvalue(PspecVar* const pspec_var, const GValue* value) {
+DEFINE_ACCESSORS(boolean, gboolean, g_value_get_boolean, g_value_set_boolean)
+DEFINE_ACCESSORS(int, gint, g_value_get_int, g_value_set_int)
+DEFINE_ACCESSORS(uint, guint, g_value_get_uint, g_value_set_uint)
+DEFINE_ACCESSORS(float, gfloat, g_value_get_float, g_value_set_float)
+DEFINE_ACCESSORS(double, gdouble, g_value_get_double, g_value_set_double)
+DEFINE_ACCESSORS(enum, guint, g_value_get_enum, g_value_set_enum)
+
+static void pspec_var_accessors_init(PspecVar* const pspec_var) {
   switch (pspec_var->pspec->value_type) {
   case G_TYPE_BOOLEAN:
-    (*(gboolean*)pspec_var->var) = g_value_get_boolean(value);
+    pspec_var->get = get_boolean;
+    pspec_var->set = set_boolean;
     break;
   case G_TYPE_INT:
-    (*(gint*)pspec_var->var) = g_value_get_int(value);
+    pspec_var->get = get_int;
+    pspec_var->set = set_int;
     break;
   case G_TYPE_UINT:
-    (*(guint*)pspec_var->var) = g_value_get_uint(value);
+    pspec_var->get = get_uint;
+    pspec_var->set = set_uint;
     break;
   case G_TYPE_FLOAT:
-    (*(gfloat*)pspec_var->var) = g_value_get_float(value);
+    pspec_var->get = get_float;
+    pspec_var->set = set_float;
     break;
   case G_TYPE_DOUBLE:
-    (*(gdouble*)pspec_var->var) = g_value_get_double(value);
+    pspec_var->get = get_double;
+    pspec_var->set = set_double;
     break;
   default:
-    if (g_type_is_a(pspec_var->pspec->value_type, G_TYPE_ENUM))
-      (*(guint*)pspec_var->var) = g_value_get_enum(value);
-    else
+    if (g_type_is_a(pspec_var->pspec->value_type, G_TYPE_ENUM)) {
+      pspec_var->get = get_enum;
+      pspec_var->set = set_enum;
+    } else {
       g_assert(FALSE);
+    }
   }
 }
 
+static const PspecVar* lookup(const BtPropertiesSimple* self, const GParamSpec* pspec) {
+  if (pspec->param_id >= self->idx_by_id->len)
+    return NULL;
+  
+  const gint idx = g_array_index(self->idx_by_id, gint, pspec->param_id);
+  return idx < 0 ? NULL : &g_array_index(self->props, PspecVar, idx);
+}
+
+gboolean bt_properties_simple_get(const BtPropertiesSimple* self, GParamSpec* pspec, GValue* value) {
+  const PspecVar* const pspec_var = lookup(self, pspec);
+  if (!pspec_var || pspec_var->pspec->name != pspec->name)
+    return FALSE;
+  
+  pspec_var->get(pspec_var->var, value);
+  return TRUE;
+}
+
 gboolean bt_properties_simple_set(const BtPropertiesSimple* self, GParamSpec* pspec, const GValue* value) {
-  for (guint i = 0; i < self->props->len; ++i) {
-    PspecVar* const pspec_var = &g_array_index(self->props, PspecVar, i);
-	
-    if (pspec_var->pspec == pspec) {
-      bt_properties_simple_set_from_gvalue(pspec_var, value);
-      return TRUE;
-    }
-  }
-  return FALSE;
+  const PspecVar* const pspec_var = lookup(self, pspec);
+  if (!pspec_var || pspec_var->pspec != pspec)
+    return FALSE;
+  
+  pspec_var->set(pspec_var->var, value);
+  return TRUE;
 }
 
 void bt_properties_simple_add(BtPropertiesSimple* self, const char* prop_name, void* var) {
   PspecVar pspec_var;
 
-  pspec_var.pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(self->owner), prop_name);
+  pspec_var.pspec = g_object_class_find_property(self->owner_class, prop_name);
   g_assert(pspec_var.pspec);
   
   pspec_var.var = var;
-  bt_properties_simple_set_from_gvalue(&pspec_var, g_param_spec_get_default_value(pspec_var.pspec));
+  pspec_var_accessors_init(&pspec_var);
+  pspec_var.set(pspec_var.var, g_param_spec_get_default_value(pspec_var.pspec));
+
+  const guint id = pspec_var.pspec->param_id;
+  while (self->idx_by_id->len <= id) {
+    const gint none = -1;
+    g_array_append_val(self->idx_by_id, none);
+  }
+  g_array_index(self->idx_by_id, gint, id) = (gint)self->props->len;
   
   g_array_append_val(self->props, pspec_var);
 }
@@ -122,27 +139,22 @@ void bt_properties_simple_add(BtPropertiesSimple* self, const char* prop_name, v
 void bt_properties_simple_finalize(GObject* const obj) {
   BtPropertiesSimple* const self = (BtPropertiesSimple*)obj;
   g_array_free(self->props, TRUE);
+  g_array_free(self->idx_by_id, TRUE);
   G_OBJECT_CLASS(bt_properties_simple_parent_class)->finalize(obj);
 }
 
-void bt_properties_simple_dispose(GObject* const obj) {
-  BtPropertiesSimple* const self = (BtPropertiesSimple*)obj;
-  g_clear_object(&self->owner);
-  G_OBJECT_CLASS(bt_properties_simple_parent_class)->dispose(obj);
-}
-
 void bt_properties_simple_class_init(BtPropertiesSimpleClass* const klass) {
   GObjectClass* const gobject_class = (GObjectClass*)klass;
-  gobject_class->dispose = bt_properties_simple_dispose;
   gobject_class->finalize = bt_properties_simple_finalize;
 }
 
 void bt_properties_simple_init(BtPropertiesSimple* const self) {
   self->props = g_array_new(FALSE, FALSE, sizeof(PspecVar));
+  self->idx_by_id = g_array_new(FALSE, FALSE, sizeof(gint));
 }
 
 BtPropertiesSimple* bt_properties_simple_new(GObject* owner) {
   BtPropertiesSimple* const self = (BtPropertiesSimple*)g_object_new(bt_properties_simple_get_type(), NULL);
-  self->owner = g_object_ref(owner);
+  self->owner_class = G_OBJECT_GET_CLASS(owner);
   return self;
 }
@@ -21,6 +21,9 @@
 #include <glib-object.h>
 G_DECLARE_FINAL_TYPE(BtPropertiesSimple, bt_properties_simple, BT, PROPERTIES_SIMPLE, GObject);
 
+/**
+ * @owner: The object whose class defines the properties. It isn't referenced, so that it can own the result.
+ */
 BtPropertiesSimple* bt_properties_simple_new(GObject* owner);
 
 /**
@@ -17,6 +17,10 @@
 */
 
 #include "src/propsratecontrolsource.h"
+#include "src/math.h"
+
+// The number of values converted at once by the GstControlSource functions.
+enum { VALUE_ARRAY_CHUNK = 64 };
 
 G_DEFINE_ABSTRACT_TYPE(GstBtPropSrateControlSource, gstbt_prop_srate_cs, GST_TYPE_CONTROL_SOURCE);
 
@@ -33,8 +37,47 @@ gboolean gstbt_prop_srate_cs_get_value_array_f(GstBtPropSrateControlSource* self
   return klass->get_value_array_f(self, timestamp, interval, n_values, values);
 }
 
+gboolean gstbt_prop_srate_cs_has_segments(GstBtPropSrateControlSource* self) {
+  return GSTBT_PROP_SRATE_CONTROL_SOURCE_GET_CLASS(self)->get_segments != NULL;
+}
+
+guint gstbt_prop_srate_cs_get_segments(GstBtPropSrateControlSource* self, GstClockTime timestamp,
+                                       GstClockTime interval, guint n_values, SrateSeg* segs) {
+  GstBtPropSrateControlSourceClass* klass = GSTBT_PROP_SRATE_CONTROL_SOURCE_GET_CLASS(self);
+  g_assert(klass->get_segments != NULL);
+  const guint result = klass->get_segments(self, timestamp, interval, n_values, segs);
+  g_assert(result > 0 && result <= SRATE_SEGS_MAX);
+  return result;
+}
+
+static gboolean get_value(GstControlSource* super, GstClockTime timestamp, gdouble* value) {
+  gfloat fvalue;
+  gstbt_prop_srate_cs_get_value_f((GstBtPropSrateControlSource*)super, timestamp, &fvalue);
+  *value = fvalue;
+  return TRUE;
+}
+
+// Values are made in chunks by get_value_array_f, which writes whole groups of 4, and widened to doubles.
+static gboolean get_value_array(GstControlSource* super, GstClockTime timestamp, GstClockTime interval,
+                                guint n_values, gdouble* values) {
+  v4sf chunk4[VALUE_ARRAY_CHUNK/4];
+  const gfloat* const chunk = (const gfloat*)chunk4;
+  
+  for (guint done = 0; done < n_values; done += VALUE_ARRAY_CHUNK) {
+    const guint n = MIN(VALUE_ARRAY_CHUNK, n_values - done);
+    gstbt_prop_srate_cs_get_value_array_f((GstBtPropSrateControlSource*)super, timestamp + done * interval, interval,
+                                          n, (gfloat*)chunk4);
+    for (guint i = 0; i < n; ++i)
+      values[done + i] = chunk[i];
+  }
+  
+  return TRUE;
+}
+
 void gstbt_prop_srate_cs_class_init(GstBtPropSrateControlSourceClass* const klass) {
 }
 
 void gstbt_prop_srate_cs_init(GstBtPropSrateControlSource* const self) {
+  self->parent_instance.get_value = get_value;
+  self->parent_instance.get_value_array = get_value_array;
 }
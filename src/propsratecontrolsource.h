@@ -19,6 +19,7 @@
 #pragma once
 
 #include <gst/gstcontrolsource.h>
+#include "src/sratebuf.h"
 
 /*
   A Control Source holding data that defines what property the generated values should apply to.
@@ -29,7 +30,8 @@
   
   The results are intended for use as s-rate modifiers for machine controls, and the interface is intended to give
   the client will as much latitude possible as to where and how to apply the data to make sure it's done efficiently.
-  It can also be used as a regular control source, though, if needed.
+  It can also be used as a regular control source, though, if needed. Its GstControlSource functions convert
+  batches of values from get_value_array_f, so other elements' properties are driven just as efficiently.
 */
 G_DECLARE_DERIVABLE_TYPE(GstBtPropSrateControlSource, gstbt_prop_srate_cs, GSTBT,
 						 PROP_SRATE_CONTROL_SOURCE, GstControlSource);
@@ -40,8 +42,14 @@ struct _GstBtPropSrateControlSourceClass {
   void (*get_value_f)(GstBtPropSrateControlSource* self, GstClockTime timestamp, gfloat* value);
   gboolean (*get_value_array_f)(GstBtPropSrateControlSource* self, GstClockTime timestamp, GstClockTime interval,
                                 guint n_values, gfloat* values);
+  // Optional. Describes the values as at most SRATE_SEGS_MAX segments, returning how many were written.
+  guint (*get_segments)(GstBtPropSrateControlSource* self, GstClockTime timestamp, GstClockTime interval,
+                        guint n_values, SrateSeg* segs);
 };
 
 void gstbt_prop_srate_cs_get_value_f(GstBtPropSrateControlSource* self, GstClockTime timestamp, gfloat* value);
 gboolean gstbt_prop_srate_cs_get_value_array_f(GstBtPropSrateControlSource* self, GstClockTime timestamp,
                                                GstClockTime interval, guint n_values, gfloat* values);
+gboolean gstbt_prop_srate_cs_has_segments(GstBtPropSrateControlSource* self);
+guint gstbt_prop_srate_cs_get_segments(GstBtPropSrateControlSource* self, GstClockTime timestamp,
+                                       GstClockTime interval, guint n_values, SrateSeg* segs);
@@ -0,0 +1,168 @@
+/*
+  Additive synth for Buzztrax
+  Copyright (C) 2020 David Beswick
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include "config.h"
+#include "src/rtcheck.h"
+
+#ifdef USE_DEBUG
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The C library's allocator, which the replacements below forward to.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t align, size_t size);
+extern void __libc_free(void* ptr);
+
+#define RT_CHECK_EXPORT __attribute__((visibility("default")))
+
+// The check of the thread that's rendering, or NULL. The initial-exec model keeps reading it from calling the
+// allocator, which the general model can do the first time a thread reads it.
+static __thread RtCheck* rt_check_current __attribute__((tls_model("initial-exec")));
+
+// Counts a heap call on the calling thread, if it's rendering, and records where it came from.
+static void rt_check_note(void) {
+  RtCheck* const check = rt_check_current;
+  if (!check)
+    return;
+
+  // Nothing below may be counted.
+  rt_check_current = NULL;
+
+  __atomic_add_fetch(&check->allocations, 1, __ATOMIC_RELAXED);
+
+  gpointer frames[RT_CHECK_DEPTH];
+  const gint n_frames = backtrace(frames, RT_CHECK_DEPTH);
+
+  guint i = 0;
+  while (i < check->n_sites &&
+         (check->sites[i].n_frames != n_frames ||
+          memcmp(check->sites[i].frames, frames, n_frames * sizeof(gpointer)) != 0)) {
+    ++i;
+  }
+
+  if (i < check->n_sites) {
+    ++check->sites[i].calls;
+  } else if (i < RT_CHECK_MAX_SITES) {
+    memcpy(check->sites[i].frames, frames, n_frames * sizeof(gpointer));
+    check->sites[i].n_frames = n_frames;
+    check->sites[i].calls = 1;
+    ++check->n_sites;
+  } else {
+    ++check->sites_dropped;
+  }
+
+  rt_check_current = check;
+}
+
+void rt_check_enter(RtCheck* const check) {
+  // The first backtrace loads the unwinder, which allocates, so it's done before counting starts.
+  static gboolean primed = FALSE;
+  if (!primed) {
+    gpointer frames[1];
+    backtrace(frames, 1);
+    primed = TRUE;
+  }
+
+  rt_check_current = check;
+}
+
+void rt_check_leave(RtCheck* const check, GstObject* const obj) {
+  rt_check_current = NULL;
+
+  for (; check->n_sites_reported < check->n_sites; ++check->n_sites_reported) {
+    const RtCheckSite* const site = &check->sites[check->n_sites_reported];
+    char** const symbols = backtrace_symbols(site->frames, site->n_frames);
+
+    GST_WARNING_OBJECT(obj, "Heap used on the streaming thread, %u times from:", site->calls);
+    // The first two frames are in this file.
+    for (gint i = 2; i < site->n_frames; ++i)
+      GST_WARNING_OBJECT(obj, "  %s", symbols ? symbols[i] : "?");
+
+    free(symbols);
+  }
+
+  if (check->sites_dropped) {
+    GST_WARNING_OBJECT(obj, "Heap used on the streaming thread %" G_GUINT64_FORMAT " times from unrecorded sites",
+                       check->sites_dropped);
+    check->sites_dropped = 0;
+  }
+}
+
+RT_CHECK_EXPORT void* malloc(size_t size) {
+  rt_check_note();
+  return __libc_malloc(size);
+}
+
+// The replacement above, by an address that the dynamic linker can't redirect to another library's malloc.
+static void* rt_check_malloc(size_t size) __attribute__((alias("malloc")));
+
+gboolean rt_check_live(void) {
+  static gint live = -1;
+  if (live == -1)
+    live = dlsym(RTLD_DEFAULT, "malloc") == (void*)rt_check_malloc;
+  return live;
+}
+
+RT_CHECK_EXPORT void* calloc(size_t n, size_t size) {
+  rt_check_note();
+  return __libc_calloc(n, size);
+}
+
+RT_CHECK_EXPORT void* realloc(void* ptr, size_t size) {
+  rt_check_note();
+  return __libc_realloc(ptr, size);
+}
+
+RT_CHECK_EXPORT void free(void* ptr) {
+  // Freeing takes the allocator's locks as well.
+  if (ptr)
+    rt_check_note();
+  __libc_free(ptr);
+}
+
+RT_CHECK_EXPORT void* memalign(size_t align, size_t size) {
+  rt_check_note();
+  return __libc_memalign(align, size);
+}
+
+RT_CHECK_EXPORT void* aligned_alloc(size_t align, size_t size) {
+  rt_check_note();
+  return __libc_memalign(align, size);
+}
+
+RT_CHECK_EXPORT int posix_memalign(void** ptr, size_t align, size_t size) {
+  if (align < sizeof(void*) || (align & (align - 1)) != 0)
+    return EINVAL;
+
+  rt_check_note();
+  void* const result = __libc_memalign(align, size);
+  if (!result && size)
+    return ENOMEM;
+
+  *ptr = result;
+  return 0;
+}
+
+#endif
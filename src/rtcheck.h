@@ -0,0 +1,76 @@
+/*
+  Additive synth for Buzztrax
+  Copyright (C) 2020 David Beswick
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "src/debug.h"
+#include <gst/gst.h>
+
+/*
+  Debug builds (--enable-debug) check that the streaming thread doesn't use the heap. In other builds these are
+  no-ops.
+
+  src/rtcheck.c replaces malloc, free and the rest of the allocator, and counts the calls made on a thread between
+  rt_check_enter and rt_check_leave. The first call from each call site is recorded with its backtrace, and new call
+  sites are logged as warnings when the thread leaves. The count is kept for the element to expose as a property.
+
+  The plugin is normally loaded with dlopen, after every other library has bound to the C library's allocator, so its
+  replacements are only seen by the other libraries if it's preloaded, e.g.
+  LD_PRELOAD=/path/to/libadditive.so gst-launch-1.0 ...
+  Without that, nothing is counted, which rt_check_live reports.
+
+  Only the heap is checked. Locks taken on the streaming thread aren't detected.
+*/
+
+enum { RT_CHECK_MAX_SITES = 32 };
+enum { RT_CHECK_DEPTH = 12 };
+
+typedef struct {
+  gpointer frames[RT_CHECK_DEPTH];
+  gint n_frames;
+  guint calls;
+} RtCheckSite;
+
+typedef struct {
+  guint64 allocations;
+#ifdef USE_DEBUG
+  // The call sites seen so far, of which the first "n_sites_reported" have been logged.
+  RtCheckSite sites[RT_CHECK_MAX_SITES];
+  guint n_sites;
+  guint n_sites_reported;
+  // Calls from sites that didn't fit.
+  guint64 sites_dropped;
+#endif
+} RtCheck;
+
+#ifdef USE_DEBUG
+// Starts counting heap use on the calling thread.
+void rt_check_enter(RtCheck* check);
+// Stops counting, and logs the call sites that weren't seen before.
+void rt_check_leave(RtCheck* check, GstObject* obj);
+// Whether the replacement allocator is the one the process uses, so that heap calls are being counted.
+gboolean rt_check_live(void);
+#else
+static inline void rt_check_enter(RtCheck* const check) {}
+static inline void rt_check_leave(RtCheck* const check, GstObject* const obj) {}
+#endif
+
+// The number of heap calls counted, readable from any thread.
+static inline guint64 rt_check_allocations(const RtCheck* const check) {
+  return __atomic_load_n(&check->allocations, __ATOMIC_RELAXED);
+}
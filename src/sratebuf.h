@@ -0,0 +1,260 @@
+/*
+  Additive synth for Buzztrax
+  Copyright (C) 2020 David Beswick
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "src/math.h"
+#include <glib.h>
+
+/*
+  Describes the contents of an s-rate property buffer for a block.
+
+  Most properties aren't modulated most of the time, so they're constant over a block. Constant buffers only have
+  their first group of 4 written, and consumers read them with an index masked by srate_buf_mask. Knowing the
+  shape of a buffer also lets consumers choose specialised paths, and lets modulation be skipped or done cheaply.
+*/
+typedef enum {
+  SRATE_BUF_CONST,  // every value is "value"; only the first group of 4 is written
+  SRATE_BUF_ARRAY   // arbitrary; written in full
+} SrateBufKind;
+
+typedef struct {
+  SrateBufKind kind;
+  // Only meaningful for SRATE_BUF_CONST.
+  gfloat value;
+  // A voice modulates the property in this block.
+  gboolean controlled;
+  // FALSE only if every value is known to be zero.
+  gboolean nonzero;
+} SrateBufDesc;
+
+// Makes the buffer constant, without changing whether it's controlled.
+static inline void srate_buf_set_const(SrateBufDesc* const desc, gfloat* const buf, const gfloat value) {
+  desc->kind = SRATE_BUF_CONST;
+  desc->value = value;
+  desc->nonzero = value != 0;
+  *(v4sf*)buf = value * V4SF_UNIT;
+}
+
+// Resets the buffer to an unmodulated constant.
+static inline void srate_buf_init_const(SrateBufDesc* const desc, gfloat* const buf, const gfloat value) {
+  srate_buf_set_const(desc, buf, value);
+  desc->controlled = FALSE;
+}
+
+// All ones if "buf" must be indexed normally, or zero if every index should read the first group.
+static inline guint srate_buf_mask(const SrateBufDesc* const desc) {
+  return desc->kind == SRATE_BUF_CONST ? 0 : ~0u;
+}
+
+static inline gfloat srate_buf_get(const SrateBufDesc* const desc, const gfloat* const buf, const guint i) {
+  return buf[i & srate_buf_mask(desc)];
+}
+
+static inline gboolean srate_buf_is_zero(const SrateBufDesc* const desc) {
+  return !desc->nonzero;
+}
+
+// Writes out a constant buffer in full so that it can be used as an array. The descriptor is unchanged.
+static inline void srate_buf_materialise(const SrateBufDesc* const desc, gfloat* const buf, const guint n) {
+  if (desc->kind == SRATE_BUF_CONST) {
+    v4sf* const buf4 = (v4sf*)buf;
+    for (guint i = 1; i < n4_ceil(n); ++i)
+      buf4[i] = buf4[0];
+  }
+}
+
+// Describes a buffer whose first "n" values have been written, and pads its last group of 4 with the last value.
+// Whether it's controlled is unchanged.
+static inline void srate_buf_set_array(SrateBufDesc* const desc, gfloat* const buf, const guint n) {
+  gboolean flat = TRUE;
+  gboolean nonzero = FALSE;
+  for (guint i = 0; i < n; ++i) {
+    flat = flat && buf[i] == buf[0];
+    nonzero = nonzero || buf[i] != 0;
+  }
+  
+  if (flat) {
+    srate_buf_set_const(desc, buf, buf[0]);
+    return;
+  }
+
+  for (guint i = n; i < n4_ceil(n)*4; ++i)
+    buf[i] = buf[n-1];
+  
+  desc->kind = SRATE_BUF_ARRAY;
+  desc->nonzero = nonzero;
+}
+
+// Multiplies the buffer by a modulator buffer, keeping the result as simple as the two allow.
+static inline void srate_buf_mul(SrateBufDesc* const desc, gfloat* const buf,
+                                 const SrateBufDesc* const mod, const gfloat* const mod_buf, const guint n) {
+  v4sf* const buf4 = (v4sf*)buf;
+  const v4sf* const mod4 = (const v4sf*)mod_buf;
+
+  if (mod->kind == SRATE_BUF_CONST) {
+    if (desc->kind == SRATE_BUF_CONST || mod->value == 0) {
+      srate_buf_set_const(desc, buf, srate_buf_get(desc, buf, 0) * mod->value);
+    } else {
+      for (guint i = 0; i < n4_ceil(n); ++i)
+        buf4[i] *= mod->value;
+    }
+  } else {
+    if (desc->kind == SRATE_BUF_CONST) {
+      const gfloat value = desc->value;
+      for (guint i = 0; i < n4_ceil(n); ++i)
+        buf4[i] = value * mod4[i];
+      desc->kind = SRATE_BUF_ARRAY;
+    } else {
+      for (guint i = 0; i < n4_ceil(n); ++i)
+        buf4[i] *= mod4[i];
+      desc->kind = SRATE_BUF_ARRAY;
+    }
+    desc->nonzero = desc->nonzero && mod->nonzero;
+  }
+}
+
+/*
+  A piece of a piecewise modulation signal, such as one stage of an envelope.
+
+  Frame "i" of the segment, counted from its start, has the value:
+
+    base + range * clamp(alpha + alpha_inc * i, 0, 1) ** exp
+
+  "kind" says which parts of the formula matter, so the simpler segments can be rendered cheaply, and a lone
+  constant segment needn't be written out.
+*/
+typedef enum {
+  SRATE_SEG_CONST,  // base
+  SRATE_SEG_LINEAR, // exp is 1
+  SRATE_SEG_POW
+} SrateSegKind;
+
+typedef struct {
+  // Frame at which the segment ends, exclusive. Segments run back-to-back from frame 0.
+  guint end;
+  SrateSegKind kind;
+  gfloat base;
+  gfloat range;
+  gfloat alpha;
+  gfloat alpha_inc;
+  gfloat exp;
+} SrateSeg;
+
+// The most segments that a source will produce for any block.
+#define SRATE_SEGS_MAX 8
+
+// Segments are rendered in windows of this many groups of 4, evaluated exactly at the start of each so that rounding
+// errors can't build up. Within a window, a linear segment adds a step to each group and a power curve multiplies each
+// group by a ratio. See srate_segs_render.
+#define SRATE_SEG_RESYNC_GROUPS 16
+
+// A power curve is only stepped through a window over which alpha grows by at most 1/this of its value at the start.
+// Multiplying by a ratio makes an exponential curve through the window's exact end points, and within that bound its
+// relative error is below exp/(8 * this**2), under 0.5% for the largest exponent an envelope uses.
+#define SRATE_SEG_POW_STEP_SPAN 16
+
+static inline v4sf srate_seg_at4(const SrateSeg* const seg, const v4sf i) {
+  const v4sf alpha = clamp4f(seg->alpha + seg->alpha_inc * i, V4SF_ZERO, V4SF_UNIT);
+  switch (seg->kind) {
+  case SRATE_SEG_CONST:
+    return seg->base * V4SF_UNIT;
+  case SRATE_SEG_LINEAR:
+    return seg->base + seg->range * alpha;
+  default:
+    return seg->base + seg->range * bitselect4f(alpha == V4SF_ZERO, V4SF_ZERO, powpnz4f(alpha, seg->exp * V4SF_UNIT));
+  }
+}
+
+// Renders "n" frames of "segs" into "buf", or only describes them if they amount to a single constant.
+static inline void srate_segs_render(const SrateSeg* const segs, const guint n_segs, SrateBufDesc* const desc,
+                                     gfloat* const buf, const guint n) {
+  g_assert(n_segs > 0 && segs[n_segs-1].end >= n);
+
+  if (n_segs == 1 && segs[0].kind == SRATE_SEG_CONST) {
+    srate_buf_init_const(desc, buf, segs[0].base);
+    return;
+  }
+
+  v4sf* const buf4 = (v4sf*)buf;
+  const v4sf lane = {0, 1, 2, 3};
+  const guint n4 = n4_ceil(n);
+  gboolean nonzero = FALSE;
+  guint start = 0;
+
+  for (guint s = 0; s < n_segs && start < n4*4; ++s) {
+    const SrateSeg* const seg = &segs[s];
+    // The last segment also covers the padding in the final group of 4.
+    const guint end = s == n_segs-1 ? n4*4 : MIN(seg->end, n4*4);
+
+    // A linear segment's unclamped value is stepped, and clamping it to the segment's range is the same as clamping
+    // alpha.
+    const v4sf step = seg->range * seg->alpha_inc * 4 * V4SF_UNIT;
+    const v4sf lo = MIN(seg->base, seg->base + seg->range) * V4SF_UNIT;
+    const v4sf hi = MAX(seg->base, seg->base + seg->range) * V4SF_UNIT;
+    v4sf linear_value = V4SF_ZERO;
+    // A power curve's alpha ** exp is stepped through the windows where alpha isn't clamped and the curve is close
+    // enough to exponential, and evaluated exactly for each group elsewhere, such as near the start of an attack.
+    gboolean pow_stepped = FALSE;
+    v4sf pow_value = V4SF_ZERO;
+    v4sf pow_ratio = V4SF_UNIT;
+
+    // Groups straddling a segment boundary are blended lane by lane.
+    for (guint g = start/4, k = 0; g < (end+3)/4; ++g, ++k) {
+      const v4sf idx = (gfloat)(g*4) + lane;
+      const gboolean resync = k % SRATE_SEG_RESYNC_GROUPS == 0;
+      v4sf value;
+      
+      switch (seg->kind) {
+      case SRATE_SEG_LINEAR:
+        linear_value =
+          resync ? seg->base + seg->range * (seg->alpha + seg->alpha_inc * (idx - (gfloat)start)) : linear_value + step;
+        value = clamp4f(linear_value, lo, hi);
+        break;
+      case SRATE_SEG_POW:
+        if (resync) {
+          const v4sf alpha_a = seg->alpha + seg->alpha_inc * (idx - (gfloat)start);
+          const v4sf alpha_b = alpha_a + seg->alpha_inc * (4 * SRATE_SEG_RESYNC_GROUPS);
+          const v4si steppable =
+            (alpha_a > V4SF_ZERO) & (alpha_b <= V4SF_UNIT) & ((alpha_b - alpha_a) * SRATE_SEG_POW_STEP_SPAN <= alpha_a);
+          pow_stepped = v4si_eq(steppable, V4SI_TRUE);
+          if (pow_stepped) {
+            pow_value = powpnz4f(alpha_a, seg->exp * V4SF_UNIT);
+            pow_ratio = powpnz4f(alpha_b / alpha_a, seg->exp / SRATE_SEG_RESYNC_GROUPS * V4SF_UNIT);
+          }
+        } else if (pow_stepped) {
+          pow_value *= pow_ratio;
+        }
+        value = pow_stepped ? seg->base + seg->range * pow_value : srate_seg_at4(seg, idx - (gfloat)start);
+        break;
+      default:
+        value = seg->base * V4SF_UNIT;
+      }
+      
+      const v4si in_seg = (idx >= (gfloat)start) & (idx < (gfloat)end);
+      buf4[g] = bitselect4f(in_seg, value, buf4[g]);
+    }
+
+    nonzero = nonzero || seg->base != 0 || (seg->kind != SRATE_SEG_CONST && seg->range != 0);
+    start = end;
+  }
+
+  desc->kind = SRATE_BUF_ARRAY;
+  desc->controlled = FALSE;
+  desc->nonzero = nonzero;
+}
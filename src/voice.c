@@ -29,11 +29,17 @@
 #include <unistd.h>
 #include <stdio.h>
 
+typedef struct {
+  guint idx_target_prop;
+} GstBtAdditiveVParams;
+
 struct _GstBtAdditiveV
 {
   GstObject parent;
 
-  guint idx_target_prop;
+  // The properties set on this voice. "params" points to them unless they're shared from a master voice.
+  GstBtAdditiveVParams params_own;
+  const GstBtAdditiveVParams* params;
   
   GstBtAdsr* adsr;
   GstBtLfoFloat* lfo;
@@ -41,12 +47,9 @@ struct _GstBtAdditiveV
   GParamSpec** parent_props;
   guint n_parent_props;
   
-  GParamSpec** properties;
-  guint n_properties;
-  
   guint srate_buf_size;
   v4sf* srate_buf;
-  gboolean any_nonzero;
+  SrateBufDesc srate_desc;
   GstClockTime timestamp_last;
 };
 
@@ -66,7 +69,7 @@ static void property_set(GObject* const object, const guint prop_id, const GValu
 
   switch (prop_id) {
   case PROP_IDX_TARGET_PROP:
-	self->idx_target_prop = MIN(g_value_get_enum(value), self->n_parent_props);
+	self->params_own.idx_target_prop = MIN(g_value_get_enum(value), self->n_parent_props);
 	break;
   default:
 	if (!gstbt_adsr_property_set((GObject*)self->adsr, prop_id, value, pspec) &&
@@ -82,7 +85,7 @@ static void property_get(GObject* const object, const guint prop_id, GValue* con
 
   switch (prop_id) {
   case PROP_IDX_TARGET_PROP:
-	g_value_set_enum(value, self->idx_target_prop);
+	g_value_set_enum(value, self->params_own.idx_target_prop);
 	break;
   default:
 	if (!gstbt_adsr_property_get((GObject*)self->adsr, prop_id, value, pspec) &&
@@ -92,12 +95,12 @@ static void property_get(GObject* const object, const guint prop_id, GValue* con
   }
 }
 
-void gstbt_additivev_process(GstBtAdditiveV* const self, GstBuffer* const gstbuf) {
+void gstbt_additivev_process(GstBtAdditiveV* const self, const GstClockTime timestamp) {
   // Necessary to update parameters from pattern.
   //
   // The parent machine is responsible for delgating process to any children it has; the pattern control group
   // won't have called it for each voice. Although maybe it should?
-  gst_object_sync_values((GstObject*)self, GST_BUFFER_PTS(gstbuf));
+  gst_object_sync_values((GstObject*)self, timestamp);
 }
 
 void gstbt_additivev_note_off(GstBtAdditiveV* self, GstClockTime time) {
@@ -114,14 +117,13 @@ void gstbt_additivev_mod_value_array_f_for_prop(
   GstClockTime interval,
   guint n_values,
   gfloat* values,
-  gboolean* props_active,
-  gboolean* props_controlled,
+  SrateBufDesc* descs,
   GstBtAdditiveV** voices) {
 
-  guint idx = self->idx_target_prop - 1;
+  guint idx = self->params->idx_target_prop - 1;
   if (idx < self->n_parent_props) {
-    gstbt_additivev_mod_value_array_f_for_prop_idx(self, timestamp, interval, n_values, values, props_active,
-                                                   props_controlled, voices, idx, TRUE);
+    gstbt_additivev_mod_value_array_f_for_prop_idx(self, timestamp, interval, n_values, values, descs, voices, idx,
+                                                   TRUE);
   }
 }
 
@@ -131,82 +133,78 @@ void gstbt_additivev_mod_value_array_f_for_prop_idx(
   GstClockTime interval,
   guint n_values,
   gfloat* values,
-  gboolean* props_active,
-  gboolean* props_controlled,
+  SrateBufDesc* descs,
   GstBtAdditiveV** voices,
   guint property_idx,
   gboolean use_lfo) {
 
-  g_assert(self->srate_buf_size);
+  g_assert(n_values <= self->srate_buf_size);
   
   // This function might be called multiple times in a frame as a voice could be targeting both a synth param and one
   // or more voice params. If the same timestamp is used, then the same result is modulated with "values".
   if (timestamp != self->timestamp_last) {
     self->timestamp_last = timestamp;
     
-    self->any_nonzero = gstbt_prop_srate_cs_get_value_array_f(
-      (GstBtPropSrateControlSource*)self->adsr, timestamp, interval, n_values, (gfloat*)self->srate_buf);
-
-    if (use_lfo) {
-      self->any_nonzero =
+    // The envelope is only written out where it isn't constant, so a sustained or finished note modulates its
+    // target with a constant.
+    SrateSeg segs[SRATE_SEGS_MAX];
+    const guint n_segs =
+      gstbt_prop_srate_cs_get_segments((GstBtPropSrateControlSource*)self->adsr, timestamp, interval, n_values, segs);
+    srate_segs_render(segs, n_segs, &self->srate_desc, (gfloat*)self->srate_buf, n_values);
+
+    // The LFO only multiplies the envelope, so while the envelope is silent the LFO's samples aren't needed. Its phase
+    // still moves on, so that it's where it would be when the next note starts.
+    if (use_lfo && gstbt_lfo_float_is_active(self->lfo) && srate_buf_is_zero(&self->srate_desc)) {
+      gstbt_lfo_float_advance(self->lfo, interval, n_values);
+    } else if (use_lfo && gstbt_lfo_float_is_active(self->lfo)) {
+      srate_buf_materialise(&self->srate_desc, (gfloat*)self->srate_buf, n_values);
+      self->srate_desc.kind = SRATE_BUF_ARRAY;
+      self->srate_desc.nonzero =
         gstbt_lfo_float_mod_value_array_accum(self->lfo, timestamp, interval, (gfloat*)self->srate_buf, n_values,
-                                              voices)
-        || self->any_nonzero;
+                                              voices);
     }
   }
 
-  props_active[property_idx] = props_active[property_idx] || self->any_nonzero;
-  props_controlled[property_idx] = TRUE;
-  
-  v4sf* outbuf = (v4sf*)values + self->srate_buf_size/4 * property_idx;
-  if (props_active[property_idx]) {
-    for (guint i = 0; i < self->srate_buf_size/4; ++i)
-      outbuf[i] *= self->srate_buf[i];
-  } else {
-    for (guint i = 0; i < self->srate_buf_size/4; ++i)
-      outbuf[i] = V4SF_ZERO;
-  }
+  gfloat* const outbuf = values + self->srate_buf_size * property_idx;
+  srate_buf_mul(&descs[property_idx], outbuf, &self->srate_desc, (const gfloat*)self->srate_buf, n_values);
+  descs[property_idx].controlled = TRUE;
 }
 
-void gstbt_additivev_on_buf_size_change(GstBtAdditiveV* const self, guint n_samples) {
-  self->srate_buf_size = n_samples;
-  self->srate_buf = g_realloc(self->srate_buf, sizeof(gfloat)*self->srate_buf_size);
-  gstbt_lfo_float_on_buf_size_change(self->lfo, n_samples);
+static gsize align_up(const gsize size, const gsize align) {
+  return (size + align - 1) / align * align;
 }
 
-void gstbt_additivev_copy(GstBtAdditiveV* src, GstBtAdditiveV* dst) {
-  for (guint i = 0; i < src->n_properties; ++i) {
-    // "name" is a GStreamer property, and "parented objects can't be renamed."
-    if (g_strcmp0(src->properties[i]->name, "name") == 0)
-      continue;
-    
-    GValue src_v = G_VALUE_INIT;
-    g_value_init(&src_v, src->properties[i]->value_type);
+// The voice's modulation buffer is followed by its LFO's buffers, which it multiplies into.
+gsize gstbt_additivev_buffers_size(guint n_samples, gsize align) {
+  return align_up(sizeof(gfloat) * n_samples, align) + align_up(gstbt_lfo_float_buffer_size(n_samples), align);
+}
 
-    g_object_get_property((GObject*)src, src->properties[i]->name, &src_v);
-    g_object_set_property((GObject*)dst, src->properties[i]->name, &src_v);
+void gstbt_additivev_buffers_set(GstBtAdditiveV* const self, guint n_samples, gsize align, gpointer mem) {
+  g_assert((guintptr)mem % align == 0);
+  self->srate_buf_size = n_samples;
+  self->srate_buf = mem;
+  gstbt_lfo_float_buffer_set(self->lfo, n_samples, (guint8*)mem + align_up(sizeof(gfloat) * n_samples, align));
 
-    g_value_unset(&src_v);
-  }
+  // The memory might be new, so any cached modulation is lost.
+  self->timestamp_last = -1;
+}
+
+void gstbt_additivev_share_params(GstBtAdditiveV* const self, const GstBtAdditiveV* const master) {
+  self->params = &master->params_own;
+  gstbt_adsr_share_params(self->adsr, master->adsr);
+  gstbt_lfo_float_share_params(self->lfo, master->lfo);
 }
 
 static void gstbt_additivev_init(GstBtAdditiveV* const self) {
+  self->params = &self->params_own;
   self->adsr = gstbt_adsr_new((GObject*)self, "");
   self->timestamp_last = -1;
-  self->properties = g_object_class_list_properties(G_OBJECT_CLASS(G_OBJECT_GET_CLASS(self)), &self->n_properties);
-}
-
-static void finalize(GObject* const gobj) {
-  GstBtAdditiveV* const self = (GstBtAdditiveV*)gobj;
-  g_free(self->properties);
-  G_OBJECT_CLASS(gstbt_additivev_parent_class)->finalize(gobj);
 }
 
 static void dispose(GObject* const gobj) {
   GstBtAdditiveV* const self = (GstBtAdditiveV*)gobj;
   g_clear_object(&self->adsr);
   g_clear_object(&self->lfo);
-  g_clear_object(&self->srate_buf);
   G_OBJECT_CLASS(gstbt_additivev_parent_class)->dispose(gobj);
 }
 
@@ -215,7 +213,6 @@ static void gstbt_additivev_class_init(GstBtAdditiveVClass* const klass) {
   gobject_class->set_property = property_set;
   gobject_class->get_property = property_get;
   gobject_class->dispose = dispose;
-  gobject_class->finalize = finalize;
 
   const GParamFlags flags = (GParamFlags)
 	(G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS);
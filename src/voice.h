@@ -20,17 +20,24 @@
 
 #include <glib-object.h>
 #include <gst/gst.h>
+#include "src/sratebuf.h"
 
 G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE(GstBtAdditiveV, gstbt_additivev, GSTBT, ADDITIVEV, GstObject);
 
 GstBtAdditiveV* gstbt_additivev_new(GParamSpec** parent_props, guint n_parent_props, guint idx_voice);
 
-void gstbt_additivev_copy(GstBtAdditiveV* src, GstBtAdditiveV* dst);
-void gstbt_additivev_process(GstBtAdditiveV* self, GstBuffer* gstbuf);
+// Makes the voice's envelope and LFO follow "master"'s properties rather than its own, so that they needn't be
+// copied. The voice's state is still its own.
+void gstbt_additivev_share_params(GstBtAdditiveV* self, const GstBtAdditiveV* master);
+void gstbt_additivev_process(GstBtAdditiveV* self, GstClockTime timestamp);
 void gstbt_additivev_note_off(GstBtAdditiveV* self, GstClockTime time);
 void gstbt_additivev_note_on(GstBtAdditiveV* self, GstClockTime time, gfloat anticlick);
-void gstbt_additivev_on_buf_size_change(GstBtAdditiveV* self, guint n_samples);
+// Bytes of memory needed for a voice's buffers of "n_samples" s-rate samples, rounded up to "align".
+gsize gstbt_additivev_buffers_size(guint n_samples, gsize align);
+// Gives the voice memory for its buffers, of the size above and aligned to "align". The caller owns the memory, and
+// must set it again whenever it moves.
+void gstbt_additivev_buffers_set(GstBtAdditiveV* self, guint n_samples, gsize align, gpointer mem);
 
 void gstbt_additivev_mod_value_array_f_for_prop(
   GstBtAdditiveV* self,
@@ -38,8 +45,7 @@ void gstbt_additivev_mod_value_array_f_for_prop(
   GstClockTime interval,
   guint n_values,
   gfloat* values,
-  gboolean props_active[],
-  gboolean props_controlled[],
+  SrateBufDesc descs[],
   GstBtAdditiveV** voices);
 
 void gstbt_additivev_mod_value_array_f_for_prop_idx(
@@ -48,8 +54,7 @@ void gstbt_additivev_mod_value_array_f_for_prop_idx(
   GstClockTime interval,
   guint n_values,
   gfloat* values,
-  gboolean props_active[],
-  gboolean props_controlled[],
+  SrateBufDesc descs[],
   GstBtAdditiveV** voices,
   guint property_idx,
   gboolean use_lfo);